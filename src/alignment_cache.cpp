@@ -0,0 +1,409 @@
+#include <algorithm>
+#include <cstring>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alignment_cache.h"
+#include "io_error.h"
+
+
+namespace anyseq {
+
+//-------------------------------------------------------------------
+namespace {
+
+inline std::uint64_t rotl(std::uint64_t x, int r) noexcept {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline std::uint64_t fmix(std::uint64_t k) noexcept {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+constexpr std::uint64_t murmur_c1 = 0x87c37b91114253d5ULL;
+constexpr std::uint64_t murmur_c2 = 0x4cf5ad432745937fULL;
+
+
+/// @brief must match the scoring scheme of the entry points in "export.impala";
+///        keys (and cache files) of builds with other scorings don't mix
+constexpr char compiled_scoring[] = "linear_scoring_scheme(2,-1,-1)";
+
+} // namespace
+
+
+
+//-------------------------------------------------------------------
+content_hash hash_content(const void* data, std::size_t size,
+                          std::uint64_t seed) noexcept
+{
+    const auto* p = static_cast<const unsigned char*>(data);
+    const std::size_t blocks = size / 16;
+
+    std::uint64_t h1 = seed;
+    std::uint64_t h2 = seed;
+
+    for(std::size_t i = 0; i < blocks; ++i, p += 16) {
+        std::uint64_t k1, k2;
+        std::memcpy(&k1, p, 8);
+        std::memcpy(&k2, p + 8, 8);
+
+        k1 *= murmur_c1; k1 = rotl(k1, 31); k1 *= murmur_c2; h1 ^= k1;
+        h1 = rotl(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+        k2 *= murmur_c2; k2 = rotl(k2, 33); k2 *= murmur_c1; h2 ^= k2;
+        h2 = rotl(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    //little endian tail
+    const std::size_t rest = size & 15;
+    std::uint64_t k1 = 0;
+    std::uint64_t k2 = 0;
+    for(std::size_t i = rest; i > 8; --i) {
+        k2 ^= std::uint64_t(p[i - 1]) << (8 * (i - 9));
+    }
+    for(std::size_t i = std::min(rest, std::size_t(8)); i > 0; --i) {
+        k1 ^= std::uint64_t(p[i - 1]) << (8 * (i - 1));
+    }
+    if(rest > 8) {
+        k2 *= murmur_c2; k2 = rotl(k2, 33); k2 *= murmur_c1; h2 ^= k2;
+    }
+    if(rest > 0) {
+        k1 *= murmur_c1; k1 = rotl(k1, 31); k1 *= murmur_c2; h1 ^= k1;
+    }
+
+    h1 ^= std::uint64_t(size);
+    h2 ^= std::uint64_t(size);
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix(h1);
+    h2 = fmix(h2);
+    h1 += h2;
+    h2 += h1;
+
+    return content_hash{h1, h2};
+}
+
+
+
+//-------------------------------------------------------------------
+content_hash alignment_key(alignment_kind kind, bool traceback,
+                           const content_hash& query,
+                           const content_hash& subject) noexcept
+{
+    static const auto scoring =
+        hash_content(compiled_scoring, sizeof(compiled_scoring) - 1);
+
+    //order matters: (q,s) and (s,q) are different problems
+    const std::uint64_t words[] = {
+        query.hi, query.lo, subject.hi, subject.lo, scoring.hi, scoring.lo,
+        std::uint64_t(kind) << 1 | std::uint64_t(traceback)
+    };
+    return hash_content(words, sizeof(words));
+}
+
+
+
+
+/*************************************************************************//**
+ *
+ * @brief file layout: file_header | (file_entry | cigar)*
+ *
+ *****************************************************************************/
+namespace {
+
+struct file_header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrder;
+};
+
+struct file_entry {
+    std::uint64_t hi;
+    std::uint64_t lo;
+    std::int32_t score;
+    anyseq_alignment_info info;
+};
+
+static_assert(sizeof(file_header) == 16, "unexpected padding");
+static_assert(sizeof(file_entry) == 40, "unexpected padding");
+
+constexpr char cache_magic[8] = {'A','N','Y','S','E','Q','R','C'};
+constexpr std::uint32_t cache_version = 1;
+constexpr std::uint32_t cache_byte_order = 0x01020304;
+
+/// @brief no valid CIGAR is longer than both sequences together
+constexpr std::int32_t max_cigar_length = std::int32_t(1) << 28;
+
+
+//-------------------------------------------------------------------
+std::size_t entry_bytes(std::size_t cigarLength) noexcept
+{
+    //list node + hash table node + CIGAR
+    return sizeof(file_entry) + 64 + cigarLength * sizeof(std::uint32_t);
+}
+
+} // namespace
+
+
+
+//-------------------------------------------------------------------
+alignment_cache::alignment_cache(const alignment_cache_options& opt):
+    shardLimit_{opt.memoryLimit / shard_count},
+    shards_{new shard[shard_count]},
+    hits_{0}, diskHits_{0}, misses_{0}, evictions_{0},
+    filename_{opt.filename},
+    fileMutex_{}, file_{nullptr}, fileEnd_{0}, fileIndex_{}
+{
+    if(filename_.empty()) return;
+    try {
+        open_file();
+    }
+    catch(...) {
+        if(file_) std::fclose(file_);
+        throw;
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+alignment_cache::~alignment_cache()
+{
+    if(file_) std::fclose(file_);
+}
+
+
+
+//-------------------------------------------------------------------
+void alignment_cache::open_file()
+{
+    file_ = std::fopen(filename_.c_str(), "r+b");
+    if(!file_) file_ = std::fopen(filename_.c_str(), "w+b");
+    if(!file_) {
+        throw file_access_error{"can't open cache file " + filename_};
+    }
+
+    struct stat st;
+    if(::fstat(::fileno(file_), &st) != 0) {
+        throw file_access_error{"can't access cache file " + filename_};
+    }
+    const auto size = std::uint64_t(st.st_size);
+
+    file_header header;
+    if(size == 0) {
+        std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+        header.version = cache_version;
+        header.byteOrder = cache_byte_order;
+        if(std::fwrite(&header, sizeof(header), 1, file_) != 1) {
+            throw file_write_error{"can't write cache file " + filename_};
+        }
+        fileEnd_ = sizeof(header);
+        return;
+    }
+
+    if(size < sizeof(header) ||
+       std::fread(&header, sizeof(header), 1, file_) != 1 ||
+       std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0)
+    {
+        throw io_format_error{filename_ + " is not an alignment cache file"};
+    }
+    if(header.version != cache_version || header.byteOrder != cache_byte_order) {
+        throw io_format_error{"alignment cache file " + filename_ +
+                              " was written by another version or platform"};
+    }
+
+    //index; entries are skipped over, their CIGARs are read on demand
+    std::uint64_t pos = sizeof(header);
+    file_entry e;
+    while(pos + sizeof(e) <= size && std::fread(&e, sizeof(e), 1, file_) == 1) {
+        if(e.info.cigar_length < 0 || e.info.cigar_length > max_cigar_length) break;
+        const auto end = pos + sizeof(e) +
+                         std::uint64_t(e.info.cigar_length) * sizeof(std::uint32_t);
+        if(end > size) break;
+        if(std::fseek(file_, long(end), SEEK_SET) != 0) break;
+        fileIndex_[content_hash{e.hi, e.lo}] = pos;
+        pos = end;
+    }
+
+    if(pos < size) {
+        if(::ftruncate(::fileno(file_), off_t(pos)) != 0) {
+            throw file_write_error{"can't repair cache file " + filename_};
+        }
+    }
+    fileEnd_ = pos;
+}
+
+
+
+//-------------------------------------------------------------------
+bool alignment_cache::find(const content_hash& key, score_t& score,
+                           anyseq_alignment_info& info,
+                           std::vector<std::uint32_t>& cigar)
+{
+    {
+        auto& s = shard_of(key);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto i = s.index.find(key);
+        if(i != s.index.end()) {
+            s.lru.splice(s.lru.begin(), s.lru, i->second);
+            const auto& e = *i->second;
+            score = e.score;
+            info = e.info;
+            cigar = e.cigar;
+            ++hits_;
+            return true;
+        }
+    }
+    if(file_ && find_disk(key, score, info, cigar)) {
+        ++diskHits_;
+        insert_memory(key, score, info, cigar.data());
+        return true;
+    }
+    ++misses_;
+    return false;
+}
+
+
+
+//-------------------------------------------------------------------
+bool alignment_cache::find_disk(const content_hash& key, score_t& score,
+                                anyseq_alignment_info& info,
+                                std::vector<std::uint32_t>& cigar)
+{
+    std::lock_guard<std::mutex> lock(fileMutex_);
+
+    auto i = fileIndex_.find(key);
+    if(i == fileIndex_.end()) return false;
+
+    file_entry e;
+    if(std::fseek(file_, long(i->second), SEEK_SET) != 0 ||
+       std::fread(&e, sizeof(e), 1, file_) != 1)
+    {
+        throw file_read_error{"can't read cache file " + filename_};
+    }
+    cigar.resize(std::size_t(e.info.cigar_length));
+    if(!cigar.empty() &&
+       std::fread(cigar.data(), sizeof(std::uint32_t), cigar.size(), file_) != cigar.size())
+    {
+        throw file_read_error{"can't read cache file " + filename_};
+    }
+    score = e.score;
+    info = e.info;
+    return true;
+}
+
+
+
+//-------------------------------------------------------------------
+void alignment_cache::insert(const content_hash& key, score_t score,
+                             const anyseq_alignment_info& info,
+                             const std::uint32_t* cigar)
+{
+    insert_memory(key, score, info, cigar);
+    if(file_) insert_disk(key, score, info, cigar);
+}
+
+
+
+//-------------------------------------------------------------------
+void alignment_cache::insert_memory(const content_hash& key, score_t score,
+                                    const anyseq_alignment_info& info,
+                                    const std::uint32_t* cigar)
+{
+    const auto n = std::size_t(std::max(0, info.cigar_length));
+    const auto bytes = entry_bytes(n);
+    if(bytes > shardLimit_) return;
+
+    auto& s = shard_of(key);
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    //another thread may have been faster
+    if(s.index.find(key) != s.index.end()) return;
+
+    while(!s.lru.empty() && s.bytes + bytes > shardLimit_) {
+        const auto& last = s.lru.back();
+        s.bytes -= entry_bytes(last.cigar.size());
+        s.index.erase(last.key);
+        s.lru.pop_back();
+        ++evictions_;
+    }
+
+    s.lru.push_front(entry{key, score, info,
+                           std::vector<std::uint32_t>(cigar, cigar + n)});
+    s.index.emplace(key, s.lru.begin());
+    s.bytes += bytes;
+}
+
+
+
+//-------------------------------------------------------------------
+void alignment_cache::insert_disk(const content_hash& key, score_t score,
+                                  const anyseq_alignment_info& info,
+                                  const std::uint32_t* cigar)
+{
+    std::lock_guard<std::mutex> lock(fileMutex_);
+
+    if(fileIndex_.find(key) != fileIndex_.end()) return;
+
+    file_entry e;
+    std::memset(&e, 0, sizeof(e));
+    e.hi = key.hi;
+    e.lo = key.lo;
+    e.score = score;
+    e.info = info;
+    if(e.info.cigar_length < 0) e.info.cigar_length = 0;
+    const auto n = std::size_t(e.info.cigar_length);
+
+    if(std::fseek(file_, long(fileEnd_), SEEK_SET) != 0 ||
+       std::fwrite(&e, sizeof(e), 1, file_) != 1 ||
+       (n > 0 && std::fwrite(cigar, sizeof(std::uint32_t), n, file_) != n))
+    {
+        throw file_write_error{"can't write cache file " + filename_};
+    }
+    fileIndex_.emplace(key, fileEnd_);
+    fileEnd_ += sizeof(e) + n * sizeof(std::uint32_t);
+}
+
+
+
+//-------------------------------------------------------------------
+void alignment_cache::flush()
+{
+    std::lock_guard<std::mutex> lock(fileMutex_);
+    if(file_ && std::fflush(file_) != 0) {
+        throw file_write_error{"can't write cache file " + filename_};
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+alignment_cache_statistics alignment_cache::statistics() const
+{
+    alignment_cache_statistics stats;
+    stats.hits = hits_;
+    stats.diskHits = diskHits_;
+    stats.misses = misses_;
+    stats.evictions = evictions_;
+
+    for(std::size_t i = 0; i < shard_count; ++i) {
+        auto& s = shards_[i];
+        std::lock_guard<std::mutex> lock(s.mutex);
+        stats.entries += s.index.size();
+        stats.bytes += s.bytes;
+    }
+    {
+        std::lock_guard<std::mutex> lock(fileMutex_);
+        stats.diskEntries = fileIndex_.size();
+    }
+    return stats;
+}
+
+
+} // namespace anyseq
@@ -0,0 +1,170 @@
+#ifndef ANYSEQ_ALIGNMENT_CACHE_H_
+#define ANYSEQ_ALIGNMENT_CACHE_H_
+
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "import.h"
+#include "session.h"
+
+
+namespace anyseq {
+
+
+/*************************************************************************//**
+ *
+ * @brief 128 bit content hash (MurmurHash3 x64/128)
+ *
+ *****************************************************************************/
+struct content_hash {
+    std::uint64_t hi = 0;
+    std::uint64_t lo = 0;
+
+    friend bool
+    operator == (const content_hash& a, const content_hash& b) noexcept {
+        return a.hi == b.hi && a.lo == b.lo;
+    }
+    friend bool
+    operator != (const content_hash& a, const content_hash& b) noexcept {
+        return !(a == b);
+    }
+};
+
+struct content_hash_hasher {
+    std::size_t operator () (const content_hash& h) const noexcept {
+        return std::size_t(h.lo);
+    }
+};
+
+
+content_hash hash_content(const void* data, std::size_t size,
+                          std::uint64_t seed = 0) noexcept;
+
+
+/** @brief key of one alignment problem: both sequences, the alignment kind,
+ *         whether a traceback is needed and the scoring compiled into
+ *         the Impala entry points */
+content_hash alignment_key(alignment_kind, bool traceback,
+                           const content_hash& query,
+                           const content_hash& subject) noexcept;
+
+
+
+//-------------------------------------------------------------------
+struct alignment_cache_options {
+    /** @brief bytes of results kept in memory (least recently used
+     *         results are dropped first); 0 keeps only the file */
+    std::size_t memoryLimit = std::size_t(256) << 20;
+    /** @brief persistent tier; results survive the process if not empty */
+    std::string filename;
+};
+
+
+struct alignment_cache_statistics {
+    std::uint64_t hits = 0;         //found in memory
+    std::uint64_t diskHits = 0;     //found in the file
+    std::uint64_t misses = 0;
+    std::uint64_t evictions = 0;
+    std::uint64_t entries = 0;      //in memory
+    std::uint64_t bytes = 0;        //in memory
+    std::uint64_t diskEntries = 0;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief alignment results by alignment_key
+ *
+ *        results are kept in a least-recently-used list that is split
+ *        into shards with their own locks, so that alignment threads
+ *        rarely wait for each other; with a file, every new result is
+ *        also appended to it and results that are only found there are
+ *        moved to memory again
+ *
+ *        the file is read once on construction to build its index; a
+ *        truncated last entry (e.g. after a crash) is cut off
+ *
+ *****************************************************************************/
+class alignment_cache
+{
+public:
+    /** @brief throws file_access_error or io_format_error
+     *         if the file can't be used */
+    explicit
+    alignment_cache(const alignment_cache_options& = alignment_cache_options{});
+
+    ~alignment_cache();
+
+    alignment_cache(const alignment_cache&) = delete;
+    alignment_cache& operator = (const alignment_cache&) = delete;
+
+    /** @brief copies a known result; the cigar gets info.cigar_length entries */
+    bool find(const content_hash& key, score_t& score, anyseq_alignment_info& info,
+              std::vector<std::uint32_t>& cigar);
+
+    /** @brief 'cigar' holds info.cigar_length entries */
+    void insert(const content_hash& key, score_t score,
+                const anyseq_alignment_info& info, const std::uint32_t* cigar);
+
+    /** @brief writes buffered file output */
+    void flush();
+
+    alignment_cache_statistics statistics() const;
+
+private:
+    struct entry {
+        content_hash key;
+        score_t score;
+        anyseq_alignment_info info;
+        std::vector<std::uint32_t> cigar;
+    };
+
+    struct shard {
+        std::mutex mutex;
+        std::list<entry> lru;       //most recently used first
+        std::unordered_map<content_hash,std::list<entry>::iterator,
+                           content_hash_hasher> index;
+        std::size_t bytes = 0;
+    };
+
+    static constexpr std::size_t shard_count = 16;
+
+    shard& shard_of(const content_hash& key) noexcept {
+        return shards_[key.hi % shard_count];
+    }
+
+    void insert_memory(const content_hash& key, score_t score,
+                       const anyseq_alignment_info& info, const std::uint32_t* cigar);
+    bool find_disk(const content_hash& key, score_t& score,
+                   anyseq_alignment_info& info, std::vector<std::uint32_t>& cigar);
+    void insert_disk(const content_hash& key, score_t score,
+                     const anyseq_alignment_info& info, const std::uint32_t* cigar);
+    void open_file();
+
+    std::size_t shardLimit_;
+    std::unique_ptr<shard[]> shards_;
+    std::atomic<std::uint64_t> hits_;
+    std::atomic<std::uint64_t> diskHits_;
+    std::atomic<std::uint64_t> misses_;
+    std::atomic<std::uint64_t> evictions_;
+    std::string filename_;
+    mutable std::mutex fileMutex_;
+    std::FILE* file_;
+    std::uint64_t fileEnd_;
+    std::unordered_map<content_hash,std::uint64_t,content_hash_hasher> fileIndex_;
+};
+
+
+} // namespace anyseq
+
+
+#endif
@@ -1,7 +1,7 @@
 #include <iostream>
 #include <cstring>
 #include <algorithm>
-#include <iterator>
+#include <stdexcept>
 
 #include "alignment_io.h"
 
@@ -21,21 +21,370 @@ void print_alignment(std::ostream& os,
     // std::size_t n = q.find(' ');
     std::size_t n = q.size();
 
+    //whole lines instead of single characters
+    std::string matches;
     for(std::size_t i = 0, j = 0; i < n; i += maxWidth) {
         j = std::min(n, i + maxWidth);
 
-        std::copy(q.begin() + i, q.begin() + j, std::ostream_iterator<char>(os));
+        os.write(q.data() + i, std::streamsize(j - i));
         os << '\n';
 
+        matches.clear();
         for(std::size_t k = i; k < j; ++k) {
-            if(q[k] == s[k]) os << '|'; else os << ' ';
+            matches += q[k] == s[k] ? '|' : ' ';
         }
-        os << '\n';
+        os << matches << '\n';
 
-        std::copy(s.begin() + i, s.begin() + j, std::ostream_iterator<char>(os));
+        os.write(s.data() + i, std::streamsize(j - i));
         os << "\n\n";
     }
 }
 
 
+
+//-------------------------------------------------------------------
+namespace {
+
+constexpr char cigar_ops[] = "MIDNSHP=X";
+
+constexpr char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+
+//-------------------------------------------------------------------
+/// @brief decimal digits without std::to_string's temporary
+void append_uint(std::string& out, std::uint64_t x)
+{
+    char buf[20];
+    char* p = buf + sizeof(buf);
+    while(x >= 100) {
+        const auto d = std::size_t(x % 100) * 2;
+        x /= 100;
+        *--p = digit_pairs[d + 1];
+        *--p = digit_pairs[d];
+    }
+    if(x >= 10) {
+        const auto d = std::size_t(x) * 2;
+        *--p = digit_pairs[d + 1];
+        *--p = digit_pairs[d];
+    } else {
+        *--p = char('0' + x);
+    }
+    out.append(p, std::size_t(buf + sizeof(buf) - p));
+}
+
+
+//-------------------------------------------------------------------
+void append_int(std::string& out, std::int64_t x)
+{
+    if(x < 0) {
+        out += '-';
+        append_uint(out, std::uint64_t(0) - std::uint64_t(x));
+    } else {
+        append_uint(out, std::uint64_t(x));
+    }
+}
+
+
+//-------------------------------------------------------------------
+/// @brief header up to the first white space or '*' if empty
+void append_name(std::string& out, const char* header, std::size_t size)
+{
+    std::size_t n = 0;
+    while(n < size && header[n] != ' ' && header[n] != '\t') ++n;
+    if(n > 0) out.append(header, n); else out += '*';
+}
+
+
+//-------------------------------------------------------------------
+void append_cigar(std::string& out, const std::uint32_t* cigar, std::size_t length)
+{
+    for(std::size_t i = 0; i < length; ++i) {
+        const auto op = cigar[i] & 0xf;
+        append_uint(out, cigar[i] >> 4);
+        out += op < sizeof(cigar_ops) - 1 ? cigar_ops[op] : '?';
+    }
+}
+
+
+//-------------------------------------------------------------------
+/// @brief counts from the CIGAR and the aligned sequences
+struct alignment_counts {
+    std::uint64_t matches = 0;
+    std::uint64_t mismatches = 0;
+    std::uint64_t gaps = 0;         //inserted and deleted bases
+    std::uint64_t gapOpens = 0;
+    std::uint64_t columns = 0;
+
+    std::uint64_t edit_distance() const noexcept { return mismatches + gaps; }
+};
+
+alignment_counts count(const alignment_record& a)
+{
+    alignment_counts c;
+    const char* q = a.query + a.info.query_begin;
+    const char* s = a.subject + a.info.subject_begin;
+
+    for(int i = 0; i < a.info.cigar_length; ++i) {
+        const auto len = a.cigar[i] >> 4;
+        switch(a.cigar[i] & 0xf) {
+            case 0:
+                for(std::uint32_t k = 0; k < len; ++k) {
+                    //ignore case (soft-masking)
+                    if(((q[k] ^ s[k]) & ~0x20) == 0) ++c.matches; else ++c.mismatches;
+                }
+                q += len;
+                s += len;
+                break;
+            case 1: q += len; c.gaps += len; ++c.gapOpens; break;
+            case 2: s += len; c.gaps += len; ++c.gapOpens; break;
+            default: break;
+        }
+        c.columns += len;
+    }
+    return c;
+}
+
+
+
+/*************************************************************************//**
+ *
+ *****************************************************************************/
+class tabular_formatter :
+    public alignment_formatter
+{
+public:
+    void format(const alignment_record& a, std::string& out) const override {
+        append_name(out, a.queryHeader, a.queryHeaderSize);
+        out += '\t';
+        append_name(out, a.subjectHeader, a.subjectHeaderSize);
+        out += '\t';
+        append_int(out, a.score);
+        for(auto x : {a.info.query_begin, a.info.query_end,
+                      a.info.subject_begin, a.info.subject_end})
+        {
+            out += '\t';
+            append_int(out, x);
+        }
+        out += '\t';
+        if(a.info.cigar_length > 0) {
+            append_cigar(out, a.cigar, a.info.cigar_length);
+        } else {
+            out += '*';
+        }
+        out += '\n';
+    }
+};
+
+
+
+/*************************************************************************//**
+ *
+ *****************************************************************************/
+class sam_formatter :
+    public alignment_formatter
+{
+public:
+    void header(const sequence_records* references,
+                std::string& out) const override
+    {
+        out += "@HD\tVN:1.6\tSO:unsorted\n";
+        if(references) {
+            for(const auto& r : *references) {
+                out += "@SQ\tSN:";
+                append_name(out, r.header, r.header_size);
+                out += "\tLN:";
+                append_uint(out, r.size);
+                out += '\n';
+            }
+        }
+        out += "@PG\tID:anyseq\tPN:anyseq\n";
+    }
+
+    void format(const alignment_record& a, std::string& out) const override {
+        const bool mapped = a.info.cigar_length > 0;
+
+        append_name(out, a.queryHeader, a.queryHeaderSize);
+        if(mapped) {
+            out += "\t0\t";
+            append_name(out, a.subjectHeader, a.subjectHeaderSize);
+            out += '\t';
+            append_int(out, a.info.subject_begin + 1);
+            out += "\t255\t";
+            //unaligned query ends are soft-clipped
+            if(a.info.query_begin > 0) {
+                append_int(out, a.info.query_begin);
+                out += 'S';
+            }
+            append_cigar(out, a.cigar, a.info.cigar_length);
+            if(std::size_t(a.info.query_end) < a.lenq) {
+                append_uint(out, a.lenq - std::size_t(a.info.query_end));
+                out += 'S';
+            }
+        } else {
+            out += "\t4\t*\t0\t0\t*";
+        }
+        out += "\t*\t0\t0\t";
+        if(a.lenq > 0) out.append(a.query, a.lenq); else out += '*';
+        out += '\t';
+        if(a.queryQualitiesSize == a.lenq && a.lenq > 0) {
+            out.append(a.queryQualities, a.queryQualitiesSize);
+        } else {
+            out += '*';
+        }
+        if(mapped) {
+            out += "\tNM:i:";
+            append_uint(out, count(a).edit_distance());
+        }
+        out += "\tAS:i:";
+        append_int(out, a.score);
+        out += '\n';
+    }
+};
+
+
+
+/*************************************************************************//**
+ *
+ *****************************************************************************/
+class paf_formatter :
+    public alignment_formatter
+{
+public:
+    void format(const alignment_record& a, std::string& out) const override {
+        if(a.info.cigar_length < 1) return;
+        const auto c = count(a);
+
+        append_name(out, a.queryHeader, a.queryHeaderSize);
+        out += '\t';
+        append_uint(out, a.lenq);
+        out += '\t';
+        append_int(out, a.info.query_begin);
+        out += '\t';
+        append_int(out, a.info.query_end);
+        out += "\t+\t";
+        append_name(out, a.subjectHeader, a.subjectHeaderSize);
+        out += '\t';
+        append_uint(out, a.lens);
+        out += '\t';
+        append_int(out, a.info.subject_begin);
+        out += '\t';
+        append_int(out, a.info.subject_end);
+        out += '\t';
+        append_uint(out, c.matches);
+        out += '\t';
+        append_uint(out, c.columns);
+        out += "\t255\tNM:i:";
+        append_uint(out, c.edit_distance());
+        out += "\tAS:i:";
+        append_int(out, a.score);
+        out += "\tcg:Z:";
+        append_cigar(out, a.cigar, a.info.cigar_length);
+        out += '\n';
+    }
+};
+
+
+
+/*************************************************************************//**
+ *
+ *****************************************************************************/
+class blast_formatter :
+    public alignment_formatter
+{
+public:
+    void format(const alignment_record& a, std::string& out) const override {
+        if(a.info.cigar_length < 1) return;
+        const auto c = count(a);
+
+        append_name(out, a.queryHeader, a.queryHeaderSize);
+        out += '\t';
+        append_name(out, a.subjectHeader, a.subjectHeaderSize);
+        out += '\t';
+        //percent identity with 3 decimals
+        const auto pid = c.columns > 0 ? (c.matches * 100000 + c.columns / 2) / c.columns : 0;
+        append_uint(out, pid / 1000);
+        out += '.';
+        const auto frac = pid % 1000;
+        if(frac < 100) out += '0';
+        if(frac < 10) out += '0';
+        append_uint(out, frac);
+        out += '\t';
+        append_uint(out, c.columns);
+        out += '\t';
+        append_uint(out, c.mismatches);
+        out += '\t';
+        append_uint(out, c.gapOpens);
+        //1-based, inclusive
+        for(auto x : {a.info.query_begin + 1, a.info.query_end,
+                      a.info.subject_begin + 1, a.info.subject_end})
+        {
+            out += '\t';
+            append_int(out, x);
+        }
+        out += "\t*\t";
+        append_int(out, a.score);
+        out += '\n';
+    }
+};
+
+} // namespace
+
+
+
+//-------------------------------------------------------------------
+std::string cigar_string(const std::uint32_t* cigar, std::size_t length)
+{
+    std::string s;
+    append_cigar(s, cigar, length);
+    return s;
+}
+
+
+
+//-------------------------------------------------------------------
+alignment_format parse_alignment_format(const std::string& name)
+{
+    if(name == "tab")   return alignment_format::tabular;
+    if(name == "sam")   return alignment_format::sam;
+    if(name == "paf")   return alignment_format::paf;
+    if(name == "blast") return alignment_format::blast;
+    throw std::invalid_argument{"unknown output format " + name};
+}
+
+
+
+//-------------------------------------------------------------------
+void alignment_formatter::header(const sequence_records*, std::string&) const
+{}
+
+
+
+//-------------------------------------------------------------------
+std::unique_ptr<alignment_formatter>
+make_alignment_formatter(alignment_format format)
+{
+    switch(format) {
+        default:
+        case alignment_format::tabular:
+            return std::unique_ptr<alignment_formatter>{new tabular_formatter{}};
+        case alignment_format::sam:
+            return std::unique_ptr<alignment_formatter>{new sam_formatter{}};
+        case alignment_format::paf:
+            return std::unique_ptr<alignment_formatter>{new paf_formatter{}};
+        case alignment_format::blast:
+            return std::unique_ptr<alignment_formatter>{new blast_formatter{}};
+    }
+}
+
+
 } //namespace anyseq
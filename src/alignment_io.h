@@ -1,10 +1,14 @@
 #ifndef ANYSEQ_ALIGNMENT_IO_H_
 #define ANYSEQ_ALIGNMENT_IO_H_
 
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <iosfwd>
 
 #include "datatypes.h"
+#include "import.h"
+#include "sequence_io.h"
 
 
 namespace anyseq {
@@ -16,6 +20,87 @@ void print_alignment(std::ostream& os,
                      std::size_t maxWidth = 80);
 
 
+/// @brief text form (e.g. "12M2D30M") of a CIGAR returned by the
+///        *_alignment_cigar functions
+std::string cigar_string(const std::uint32_t* cigar, std::size_t length);
+
+
+
+/*************************************************************************//**
+ *
+ * @brief one aligned pair with its input records;
+ *        the pointers are only valid during the call that receives it
+ *
+ *****************************************************************************/
+struct alignment_record {
+    std::uint64_t number;           //pair number in input order
+    const char* queryHeader;
+    std::size_t queryHeaderSize;
+    const char* query;
+    std::size_t lenq;
+    const char* queryQualities;     //FASTQ input only
+    std::size_t queryQualitiesSize;
+    const char* subjectHeader;
+    std::size_t subjectHeaderSize;
+    const char* subject;
+    std::size_t lens;
+    score_t score;
+    /** @brief without traceback the cigar is empty and the begin
+     *         coordinates of semiglobal and local alignments are -1 */
+    anyseq_alignment_info info;
+    const std::uint32_t* cigar;     //info.cigar_length entries
+};
+
+
+
+enum class alignment_format : int { tabular, sam, paf, blast };
+
+/** @brief "tab", "sam", "paf" or "blast"; throws std::invalid_argument */
+alignment_format parse_alignment_format(const std::string&);
+
+
+
+/*************************************************************************//**
+ *
+ * @brief appends the text form of alignment records to a buffer
+ *
+ *        formatters have no state, so any number of threads can format
+ *        into their own buffers at the same time; numbers are converted
+ *        without streams or locales
+ *
+ *        SAM, PAF and BLAST output need the CIGAR: records without one
+ *        (score-only runs) are written as unmapped SAM records and
+ *        skipped in PAF and BLAST output, so use tabular output for those
+ *
+ *****************************************************************************/
+class alignment_formatter
+{
+public:
+    virtual ~alignment_formatter() = default;
+
+    /** @brief text before the first record; 'references' holds the
+     *         subject records if they are known up front (SAM @SQ lines) */
+    virtual void header(const sequence_records* references,
+                        std::string& out) const;
+
+    /** @brief appends the lines of one record */
+    virtual void format(const alignment_record&, std::string& out) const = 0;
+};
+
+
+/*************************************************************************//**
+ *
+ * @brief tab-separated query name, subject name, score,
+ *        half-open query and subject ranges and CIGAR ('*' if unknown);
+ *        SAM with NM and AS tags; PAF with NM, AS and cg tags;
+ *        BLAST tabular (-outfmt 6) with the raw score as bit score
+ *        and '*' as e-value, since no search statistics are available
+ *
+ *****************************************************************************/
+std::unique_ptr<alignment_formatter>
+make_alignment_formatter(alignment_format);
+
+
 } // namespace anyseq 
 
 
@@ -0,0 +1,165 @@
+#ifndef ANYSEQ_BOUNDED_QUEUE_H_
+#define ANYSEQ_BOUNDED_QUEUE_H_
+
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+
+
+namespace anyseq {
+
+
+/*************************************************************************//**
+ *
+ * @brief lock-free multi-producer multi-consumer queue with fixed capacity
+ *
+ *        each cell carries a sequence number that tells producers and
+ *        consumers whose turn it is (D. Vyukov's bounded MPMC queue);
+ *        push waits while the queue is full, which throttles producers
+ *        to the pace of the consumers; pop fails once the queue is
+ *        closed and empty
+ *
+ *****************************************************************************/
+template<class T>
+class bounded_queue
+{
+public:
+    /** @brief capacity is rounded up to a power of two */
+    explicit
+    bounded_queue(std::size_t capacity):
+        cells_{}, mask_{0}, pad0_{}, enqueue_{0}, pad1_{}, dequeue_{0}, pad2_{},
+        closed_{false}
+    {
+        std::size_t n = 2;
+        while(n < capacity) n *= 2;
+        cells_.reset(new cell[n]);
+        mask_ = n - 1;
+        for(std::size_t i = 0; i < n; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bounded_queue(const bounded_queue&) = delete;
+    bounded_queue& operator = (const bounded_queue&) = delete;
+
+    std::size_t capacity() const noexcept { return mask_ + 1; }
+
+    /** @brief moves 'value' into the queue unless it is full */
+    bool try_push(T& value) {
+        auto pos = enqueue_.load(std::memory_order_relaxed);
+        while(true) {
+            auto& c = cells_[pos & mask_];
+            const auto seq = c.sequence.load(std::memory_order_acquire);
+            const auto diff = std::intptr_t(seq) - std::intptr_t(pos);
+            if(diff == 0) {
+                if(enqueue_.compare_exchange_weak(pos, pos + 1,
+                                                  std::memory_order_relaxed))
+                {
+                    c.value = std::move(value);
+                    c.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if(diff < 0) {
+                return false;
+            }
+            else {
+                pos = enqueue_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /** @brief moves the oldest element into 'value' unless empty */
+    bool try_pop(T& value) {
+        auto pos = dequeue_.load(std::memory_order_relaxed);
+        while(true) {
+            auto& c = cells_[pos & mask_];
+            const auto seq = c.sequence.load(std::memory_order_acquire);
+            const auto diff = std::intptr_t(seq) - std::intptr_t(pos + 1);
+            if(diff == 0) {
+                if(dequeue_.compare_exchange_weak(pos, pos + 1,
+                                                  std::memory_order_relaxed))
+                {
+                    value = std::move(c.value);
+                    c.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if(diff < 0) {
+                return false;
+            }
+            else {
+                pos = dequeue_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /** @brief waits while the queue is full */
+    void push(T value) {
+        backoff wait;
+        while(!try_push(value)) wait();
+    }
+
+    /** @brief waits while the queue is empty and not closed;
+     *         returns false once it is closed and empty */
+    bool pop(T& value) {
+        backoff wait;
+        while(!try_pop(value)) {
+            if(closed_.load(std::memory_order_acquire)) {
+                //elements pushed before close() are visible now
+                return try_pop(value);
+            }
+            wait();
+        }
+        return true;
+    }
+
+    /** @brief no more pushes; wakes up waiting consumers */
+    void close() noexcept { closed_.store(true, std::memory_order_release); }
+
+private:
+    /** @brief spins first, then yields, then sleeps
+     *         so that idle stages don't take cores from busy ones */
+    class backoff {
+    public:
+        void operator () () {
+            if(n_ < 64) {
+                ++n_;
+            }
+            else if(n_ < 1024) {
+                ++n_;
+                std::this_thread::yield();
+            }
+            else {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+    private:
+        int n_ = 0;
+    };
+
+    struct cell {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    //producers and consumers update different cache lines
+    std::unique_ptr<cell[]> cells_;
+    std::size_t mask_;
+    char pad0_[64];
+    std::atomic<std::size_t> enqueue_;
+    char pad1_[64];
+    std::atomic<std::size_t> dequeue_;
+    char pad2_[64];
+    std::atomic<bool> closed_;
+};
+
+
+} // namespace anyseq
+
+
+#endif
@@ -0,0 +1,707 @@
+#include <algorithm>
+#include <limits>
+
+#include <unistd.h>
+#include <zlib.h>
+
+#include "compressed_io.h"
+#include "timer.h"
+
+
+namespace anyseq {
+
+using std::string;
+
+
+//-------------------------------------------------------------------
+readahead_streambuf::readahead_streambuf(source_type source,
+                                         std::size_t bufferSize,
+                                         std::size_t numBuffers)
+:
+    source_{std::move(source)},
+    buffers_(std::max(numBuffers, std::size_t(2))),
+    nextFill_{0},
+    nextUse_{0},
+    endBuffer_{std::numeric_limits<std::size_t>::max()},
+    used_{false},
+    done_{false},
+    error_{},
+    stats_{},
+    mutables_{}, changed_{},
+    reader_{}
+{
+    for(auto& b : buffers_) {
+        b.data.resize(std::max(bufferSize, std::size_t(1)));
+    }
+    setg(nullptr, nullptr, nullptr);
+
+    reader_ = std::thread{[this] { read_ahead(); }};
+}
+
+
+
+//-------------------------------------------------------------------
+readahead_streambuf::~readahead_streambuf()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutables_);
+        done_ = true;
+    }
+    changed_.notify_all();
+    if(reader_.joinable()) reader_.join();
+}
+
+
+
+//-------------------------------------------------------------------
+readahead_statistics readahead_streambuf::statistics() const
+{
+    std::lock_guard<std::mutex> lock(mutables_);
+    return stats_;
+}
+
+
+
+//-------------------------------------------------------------------
+void readahead_streambuf::read_ahead()
+{
+    std::unique_lock<std::mutex> lock(mutables_);
+
+    while(true) {
+        //one buffer stays with the consumer
+        changed_.wait(lock, [this] {
+            return done_ || nextFill_ + 1 < nextUse_ + buffers_.size();
+        });
+        if(done_) return;
+
+        auto& b = buffers_[nextFill_ % buffers_.size()];
+        lock.unlock();
+
+        am::timer time;
+        time.start();
+        std::size_t size = 0;
+        string error;
+        try {
+            size = source_(b.data.data(), b.data.size());
+        }
+        catch(std::exception& e) {
+            error = e.what();
+        }
+        time.stop();
+
+        lock.lock();
+        stats_.readMicroseconds += time.microseconds();
+
+        if(!error.empty() || size == 0) {
+            error_ = error;
+            endBuffer_ = nextFill_;
+            changed_.notify_all();
+            return;
+        }
+        b.size = size;
+        b.ready = true;
+        ++nextFill_;
+        ++stats_.buffers;
+        changed_.notify_all();
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+readahead_streambuf::int_type readahead_streambuf::underflow()
+{
+    if(gptr() < egptr()) return traits_type::to_int_type(*gptr());
+
+    std::unique_lock<std::mutex> lock(mutables_);
+
+    if(used_) {
+        buffers_[(nextUse_ - 1) % buffers_.size()].ready = false;
+        used_ = false;
+        changed_.notify_all();
+    }
+
+    auto& b = buffers_[nextUse_ % buffers_.size()];
+
+    am::timer time;
+    time.start();
+    changed_.wait(lock, [&] { return b.ready || nextUse_ == endBuffer_; });
+    time.stop();
+    stats_.waitMicroseconds += time.microseconds();
+
+    if(!b.ready) {
+        if(!error_.empty()) throw file_read_error{error_};
+        setg(nullptr, nullptr, nullptr);
+        return traits_type::eof();
+    }
+
+    ++nextUse_;
+    used_ = true;
+    setg(b.data.data(), b.data.data(), b.data.data() + b.size);
+    return traits_type::to_int_type(*gptr());
+}
+
+
+
+//-------------------------------------------------------------------
+readahead_streambuf::source_type
+file_source(const string& filename)
+{
+    std::shared_ptr<std::FILE> file {std::fopen(filename.c_str(), "rb"), 
+                                     [](std::FILE* f) { if(f) std::fclose(f); }};
+    if(!file) {
+        throw file_access_error{"can't open file " + filename};
+    }
+    //the read-ahead buffers replace the stdio buffer
+    std::setvbuf(file.get(), nullptr, _IONBF, 0);
+
+    return [file,filename] (char* data, std::size_t size) {
+        auto n = std::fread(data, 1, size, file.get());
+        if(n < size && std::ferror(file.get())) {
+            throw file_read_error{"can't read file " + filename};
+        }
+        return n;
+    };
+}
+
+
+
+//-------------------------------------------------------------------
+readahead_streambuf::source_type
+gzip_source(const string& filename)
+{
+    //gzclose closes the duplicate, not the standard input itself
+    gzFile gz = filename == "-" ? gzdopen(dup(STDIN_FILENO), "rb")
+                                : gzopen(filename.c_str(), "rb");
+    std::shared_ptr<gzFile_s> file {gz, [](gzFile f) { if(f) gzclose(f); }};
+    if(!file) {
+        throw file_access_error{"can't open file " + filename};
+    }
+    gzbuffer(file.get(), 1 << 17);
+
+    return [file] (char* data, std::size_t size) {
+        //gzread takes unsigned sizes
+        size = std::min(size, std::size_t(1) << 30);
+        int n = gzread(file.get(), data, unsigned(size));
+        if(n < 0) {
+            int err = 0;
+            throw file_read_error{string("gzip: ") + gzerror(file.get(), &err)};
+        }
+        return std::size_t(n);
+    };
+}
+
+
+
+//-------------------------------------------------------------------
+readahead_statistics
+statistics(const std::streambuf* buffer)
+{
+    auto readahead = dynamic_cast<const readahead_streambuf*>(buffer);
+    return readahead ? readahead->statistics() : readahead_statistics{};
+}
+
+
+
+
+//-------------------------------------------------------------------
+namespace {
+
+constexpr std::size_t no_block = std::numeric_limits<std::size_t>::max();
+
+inline std::uint32_t read_le16(const unsigned char* p) {
+    return std::uint32_t(p[0]) | std::uint32_t(p[1]) << 8;
+}
+
+inline std::uint32_t read_le32(const unsigned char* p) {
+    return read_le16(p) | read_le16(p + 2) << 16;
+}
+
+} // namespace
+
+
+
+//-------------------------------------------------------------------
+bgzf_streambuf::bgzf_streambuf(const string& filename, unsigned threads,
+                               std::size_t maxAhead)
+:
+    file_{std::fopen(filename.c_str(), "rb")},
+    blocks_{},
+    nextRead_{0},
+    nextUse_{0},
+    endBlock_{no_block},
+    used_{false},
+    done_{false},
+    error_{},
+    mutables_{}, changed_{},
+    workers_{}
+{
+    if(!file_) {
+        throw file_access_error{"can't open file " + filename};
+    }
+    if(threads < 1) threads = std::max(std::thread::hardware_concurrency(), 1u);
+    if(maxAhead < 1) maxAhead = 4 * threads;
+
+    //one slot stays with the consumer
+    blocks_.resize(std::max(maxAhead, std::size_t(2)));
+
+    setg(nullptr, nullptr, nullptr);
+
+    for(unsigned i = 0; i < threads; ++i) {
+        workers_.emplace_back([this] { inflate_blocks(); });
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+bgzf_streambuf::~bgzf_streambuf()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutables_);
+        done_ = true;
+    }
+    changed_.notify_all();
+    for(auto& w : workers_) {
+        if(w.joinable()) w.join();
+    }
+    std::fclose(file_);
+}
+
+
+
+//-------------------------------------------------------------------
+void bgzf_streambuf::inflate_blocks()
+{
+    std::unique_lock<std::mutex> lock(mutables_);
+
+    while(true) {
+        changed_.wait(lock, [this] {
+            return done_ || !error_.empty() || endBlock_ != no_block ||
+                   nextRead_ + 1 < nextUse_ + blocks_.size();
+        });
+        if(done_ || !error_.empty() || endBlock_ != no_block) return;
+
+        const auto id = nextRead_;
+        auto& b = blocks_[id % blocks_.size()];
+        try {
+            //reads are serialized, inflating is not
+            if(!read_block(b)) {
+                endBlock_ = id;
+                changed_.notify_all();
+                return;
+            }
+            ++nextRead_;
+            lock.unlock();
+            inflate_block(b);
+            lock.lock();
+            b.ready = true;
+        }
+        catch(std::exception& e) {
+            if(!lock.owns_lock()) lock.lock();
+            error_ = e.what();
+        }
+        changed_.notify_all();
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+bool bgzf_streambuf::read_block(block& b)
+{
+    unsigned char header[12];
+    auto n = std::fread(header, 1, sizeof(header), file_);
+    if(n == 0 && std::feof(file_)) return false;
+
+    if(n < sizeof(header) || header[0] != 31 || header[1] != 139 ||
+       header[2] != 8 || !(header[3] & 4))
+    {
+        throw io_format_error{"malformed BGZF file - gzip block header expected"};
+    }
+
+    const auto xlen = read_le16(header + 10);
+    std::vector<unsigned char> extra(xlen);
+    if(std::fread(extra.data(), 1, xlen, file_) != xlen) {
+        throw io_format_error{"malformed BGZF file - truncated block header"};
+    }
+
+    //block size from the 'BC' subfield
+    std::uint32_t bsize = 0;
+    for(std::uint32_t i = 0; i + 4 <= xlen; ) {
+        const auto slen = read_le16(extra.data() + i + 2);
+        if(extra[i] == 'B' && extra[i+1] == 'C' && slen == 2 && i + 6 <= xlen) {
+            bsize = read_le16(extra.data() + i + 4) + 1;
+        }
+        i += 4 + slen;
+    }
+    //compressed data, CRC32 and ISIZE follow the header
+    if(bsize < sizeof(header) + xlen + 8) {
+        throw io_format_error{"malformed BGZF file - block size missing"};
+    }
+
+    b.compressed.resize(bsize - sizeof(header) - xlen);
+    if(std::fread(b.compressed.data(), 1, b.compressed.size(), file_) != b.compressed.size()) {
+        throw io_format_error{"malformed BGZF file - truncated block"};
+    }
+    return true;
+}
+
+
+
+//-------------------------------------------------------------------
+void bgzf_streambuf::inflate_block(block& b)
+{
+    const auto csize = b.compressed.size() - 8;
+    const auto tail  = reinterpret_cast<const unsigned char*>(b.compressed.data()) + csize;
+    const auto crc   = read_le32(tail);
+    const auto isize = read_le32(tail + 4);
+
+    b.data.resize(std::max(isize, std::uint32_t(1)));
+
+    z_stream zs;
+    zs.zalloc = Z_NULL;
+    zs.zfree  = Z_NULL;
+    zs.opaque = Z_NULL;
+    zs.next_in   = reinterpret_cast<Bytef*>(b.compressed.data());
+    zs.avail_in  = uInt(csize);
+    zs.next_out  = reinterpret_cast<Bytef*>(b.data.data());
+    zs.avail_out = uInt(b.data.size());
+
+    if(inflateInit2(&zs, -15) != Z_OK) {
+        throw io_error{"BGZF: can't initialize zlib"};
+    }
+    const auto ret = inflate(&zs, Z_FINISH);
+    const auto size = zs.total_out;
+    inflateEnd(&zs);
+
+    if(ret != Z_STREAM_END || size != isize) {
+        throw io_format_error{"malformed BGZF file - corrupt block"};
+    }
+    b.data.resize(isize);
+
+    if(crc32(0, reinterpret_cast<const Bytef*>(b.data.data()), isize) != crc) {
+        throw io_format_error{"malformed BGZF file - block checksum mismatch"};
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+bgzf_streambuf::int_type bgzf_streambuf::underflow()
+{
+    if(gptr() < egptr()) return traits_type::to_int_type(*gptr());
+
+    std::unique_lock<std::mutex> lock(mutables_);
+
+    while(true) {
+        if(used_) {
+            blocks_[(nextUse_ - 1) % blocks_.size()].ready = false;
+            used_ = false;
+            changed_.notify_all();
+        }
+
+        auto& b = blocks_[nextUse_ % blocks_.size()];
+
+        changed_.wait(lock, [&] {
+            return b.ready || !error_.empty() || nextUse_ == endBlock_;
+        });
+
+        if(b.ready) {
+            ++nextUse_;
+            used_ = true;
+            //the end-of-file marker block is empty
+            if(!b.data.empty()) {
+                setg(b.data.data(), b.data.data(), b.data.data() + b.data.size());
+                return traits_type::to_int_type(*gptr());
+            }
+        }
+        else if(!error_.empty()) {
+            throw file_read_error{error_};
+        }
+        else {
+            setg(nullptr, nullptr, nullptr);
+            return traits_type::eof();
+        }
+    }
+}
+
+
+
+
+//-------------------------------------------------------------------
+namespace {
+
+constexpr std::size_t bgzf_block_data = 0xff00;
+constexpr std::size_t bgzf_max_block = 0x10000;
+constexpr std::size_t bgzf_header_size = 18;
+
+//empty block that marks the end of a BGZF file
+constexpr unsigned char bgzf_eof[28] = {
+    31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 'B', 'C', 2, 0, 27, 0,
+    3, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+inline void write_le16(unsigned char* p, std::uint32_t x) {
+    p[0] = (unsigned char)(x & 0xff);
+    p[1] = (unsigned char)((x >> 8) & 0xff);
+}
+
+inline void write_le32(unsigned char* p, std::uint32_t x) {
+    write_le16(p, x & 0xffff);
+    write_le16(p + 2, x >> 16);
+}
+
+
+//-------------------------------------------------------------------
+/// @brief compresses one block into a complete BGZF member
+void deflate_block(z_stream& zs, const char* data, std::size_t size,
+                   std::vector<char>& block)
+{
+    block.resize(bgzf_max_block);
+    auto out = reinterpret_cast<unsigned char*>(block.data());
+
+    if(deflateReset(&zs) != Z_OK) {
+        throw io_error{"BGZF: can't reset zlib"};
+    }
+    zs.next_in   = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    zs.avail_in  = uInt(size);
+    zs.next_out  = out + bgzf_header_size;
+    zs.avail_out = uInt(bgzf_max_block - bgzf_header_size - 8);
+
+    if(deflate(&zs, Z_FINISH) != Z_STREAM_END) {
+        throw io_error{"BGZF: block doesn't fit"};
+    }
+    const auto total = bgzf_header_size + zs.total_out + 8;
+
+    std::copy(bgzf_eof, bgzf_eof + bgzf_header_size, out);
+    write_le16(out + 16, std::uint32_t(total - 1));
+
+    const auto tail = out + bgzf_header_size + zs.total_out;
+    write_le32(tail, std::uint32_t(
+        crc32(0, reinterpret_cast<const Bytef*>(data), uInt(size))));
+    write_le32(tail + 4, std::uint32_t(size));
+
+    block.resize(total);
+}
+
+} // namespace
+
+
+
+//-------------------------------------------------------------------
+bgzf_ostreambuf::bgzf_ostreambuf(std::streambuf* sink, unsigned threads,
+                                 int level)
+:
+    sink_{sink},
+    level_{level},
+    blocks_{},
+    nextFill_{0},
+    nextCompress_{0},
+    nextWrite_{0},
+    done_{false},
+    closed_{false},
+    error_{},
+    mutables_{}, changed_{},
+    workers_{}
+{
+    if(threads < 1) threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    //one slot is filled while the others are compressed or written
+    blocks_.resize(2 * std::size_t(threads) + 2);
+    for(auto& b : blocks_) b.data.resize(bgzf_block_data);
+
+    setp(blocks_[0].data.data(), blocks_[0].data.data() + bgzf_block_data);
+
+    for(unsigned i = 0; i < threads; ++i) {
+        workers_.emplace_back([this] { compress_blocks(); });
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+bgzf_ostreambuf::~bgzf_ostreambuf()
+{
+    try {
+        close();
+    }
+    catch(std::exception&) {}
+
+    {
+        std::lock_guard<std::mutex> lock(mutables_);
+        done_ = true;
+    }
+    changed_.notify_all();
+    for(auto& w : workers_) {
+        if(w.joinable()) w.join();
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+void bgzf_ostreambuf::compress_blocks()
+{
+    z_stream zs;
+    zs.zalloc = Z_NULL;
+    zs.zfree  = Z_NULL;
+    zs.opaque = Z_NULL;
+    const bool ok = deflateInit2(&zs, level_, Z_DEFLATED, -15, 8,
+                                 Z_DEFAULT_STRATEGY) == Z_OK;
+
+    std::unique_lock<std::mutex> lock(mutables_);
+
+    while(true) {
+        changed_.wait(lock, [this] {
+            return done_ || nextCompress_ < nextFill_;
+        });
+        if(done_) break;
+
+        const auto id = nextCompress_++;
+        auto& b = blocks_[id % blocks_.size()];
+        lock.unlock();
+        string error;
+        try {
+            if(!ok) throw io_error{"BGZF: can't initialize zlib"};
+            deflate_block(zs, b.data.data(), b.size, b.compressed);
+        }
+        catch(std::exception& e) {
+            error = e.what();
+        }
+        lock.lock();
+        if(!error.empty() && error_.empty()) error_ = error;
+        b.ready = true;
+        changed_.notify_all();
+    }
+    if(ok) deflateEnd(&zs);
+}
+
+
+
+//-------------------------------------------------------------------
+/// @brief hands the put area over to the workers and
+///        waits until the next slot has been written
+void bgzf_ostreambuf::submit()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutables_);
+        blocks_[nextFill_ % blocks_.size()].size = std::size_t(pptr() - pbase());
+        ++nextFill_;
+    }
+    changed_.notify_all();
+
+    if(nextFill_ + 1 > blocks_.size()) {
+        write_blocks(nextFill_ + 1 - blocks_.size());
+    }
+
+    auto& b = blocks_[nextFill_ % blocks_.size()];
+    setp(b.data.data(), b.data.data() + bgzf_block_data);
+}
+
+
+
+//-------------------------------------------------------------------
+/// @brief writes the blocks before number 'end' in order
+void bgzf_ostreambuf::write_blocks(std::size_t end)
+{
+    std::unique_lock<std::mutex> lock(mutables_);
+
+    while(nextWrite_ < end && nextWrite_ < nextFill_) {
+        auto& b = blocks_[nextWrite_ % blocks_.size()];
+        changed_.wait(lock, [&] { return b.ready; });
+        if(!error_.empty()) throw file_write_error{error_};
+
+        lock.unlock();
+        const auto size = std::streamsize(b.compressed.size());
+        const bool written = sink_->sputn(b.compressed.data(), size) == size;
+        lock.lock();
+
+        if(!written) {
+            error_ = "BGZF: can't write block";
+            throw file_write_error{error_};
+        }
+        b.ready = false;
+        ++nextWrite_;
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+bgzf_ostreambuf::int_type bgzf_ostreambuf::overflow(int_type c)
+{
+    submit();
+    if(!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+
+
+//-------------------------------------------------------------------
+int bgzf_ostreambuf::sync()
+{
+    if(closed_) return 0;
+    if(pptr() > pbase()) submit();
+    write_blocks(nextFill_);
+    return sink_->pubsync();
+}
+
+
+
+//-------------------------------------------------------------------
+void bgzf_ostreambuf::close()
+{
+    if(closed_) return;
+    if(pptr() > pbase()) submit();
+    write_blocks(nextFill_);
+    closed_ = true;
+
+    const auto size = std::streamsize(sizeof(bgzf_eof));
+    if(sink_->sputn(reinterpret_cast<const char*>(bgzf_eof), size) != size ||
+       sink_->pubsync() != 0)
+    {
+        throw file_write_error{"BGZF: can't write end-of-file block"};
+    }
+    setp(nullptr, nullptr);
+}
+
+
+
+
+//-------------------------------------------------------------------
+std::unique_ptr<std::streambuf>
+open_sequence_file(const string& filename)
+{
+    //a pipe can't be inspected twice
+    if(filename == "-") {
+        return std::unique_ptr<std::streambuf>{
+            new readahead_streambuf{gzip_source(filename)}};
+    }
+
+    unsigned char header[14] = {0};
+    std::size_t n = 0;
+    {
+        std::FILE* file = std::fopen(filename.c_str(), "rb");
+        if(!file) return nullptr;
+        n = std::fread(header, 1, sizeof(header), file);
+        std::fclose(file);
+    }
+
+    if(n >= 2 && header[0] == 31 && header[1] == 139) {
+        //BGZF blocks start with a 'BC' extra subfield
+        if(n >= 14 && (header[3] & 4) && header[12] == 'B' && header[13] == 'C') {
+            return std::unique_ptr<std::streambuf>{new bgzf_streambuf{filename}};
+        }
+        return std::unique_ptr<std::streambuf>{
+            new readahead_streambuf{gzip_source(filename)}};
+    }
+
+    return std::unique_ptr<std::streambuf>{
+        new readahead_streambuf{file_source(filename)}};
+}
+
+
+} // namespace anyseq
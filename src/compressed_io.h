@@ -0,0 +1,243 @@
+#ifndef ANYSEQ_COMPRESSED_IO_H_
+#define ANYSEQ_COMPRESSED_IO_H_
+
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "io_error.h"
+
+
+namespace anyseq {
+
+
+/*************************************************************************//**
+ *
+ * @brief time spent by a read-ahead buffer; reading time that is not
+ *        waited for by the consumer overlaps with its work
+ *
+ *****************************************************************************/
+struct readahead_statistics {
+    std::int64_t readMicroseconds = 0;  //background thread in the source
+    std::int64_t waitMicroseconds = 0;  //consumer waiting for data
+    std::size_t  buffers = 0;           //number of filled buffers
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief input buffer that is filled ahead of the consumer
+ *
+ *        a background thread calls 'source' to fill the next buffers
+ *        while the consumer parses the current one; 'source' returns
+ *        the number of bytes read and 0 at the end of the input;
+ *        its exceptions are thrown from the reading stream
+ *
+ *****************************************************************************/
+class readahead_streambuf :
+    public std::streambuf
+{
+public:
+    using source_type = std::function<std::size_t(char*, std::size_t)>;
+
+    /** @brief double buffering with 1 MiB buffers by default */
+    explicit
+    readahead_streambuf(source_type source,
+                        std::size_t bufferSize = 1 << 20,
+                        std::size_t numBuffers = 2);
+
+    readahead_streambuf(const readahead_streambuf&) = delete;
+    readahead_streambuf& operator = (const readahead_streambuf&) = delete;
+
+    ~readahead_streambuf();
+
+    readahead_statistics statistics() const;
+
+protected:
+    int_type underflow() override;
+
+private:
+    struct buffer {
+        std::vector<char> data;
+        std::size_t size = 0;
+        bool ready = false;
+    };
+
+    void read_ahead();
+
+    source_type source_;
+    std::vector<buffer> buffers_;
+    std::size_t nextFill_;      //number of the next buffer to fill
+    std::size_t nextUse_;       //number of the next buffer to hand out
+    std::size_t endBuffer_;     //number of buffers once the end is found
+    bool used_;                 //get area points to buffer 'nextUse_ - 1'
+    bool done_;
+    std::string error_;
+    readahead_statistics stats_;
+
+    mutable std::mutex mutables_;
+    std::condition_variable changed_;
+    std::thread reader_;
+};
+
+
+/** @brief reads a plain file; throws file_access_error */
+readahead_streambuf::source_type
+file_source(const std::string& filename);
+
+/** @brief reads a gzip file (also multi-member or plain) or the standard
+ *         input if 'filename' is "-"; throws file_access_error */
+readahead_streambuf::source_type
+gzip_source(const std::string& filename);
+
+/** @brief statistics of a readahead_streambuf, zero for other buffers */
+readahead_statistics
+statistics(const std::streambuf*);
+
+
+
+/*************************************************************************//**
+ *
+ * @brief input buffer for BGZF files (blocked gzip as used by samtools)
+ *
+ *        BGZF blocks are independent gzip members of at most 64 KiB
+ *        uncompressed data each; worker threads read and inflate the
+ *        blocks ahead of the consumer, at most 'maxAhead' blocks are
+ *        held in memory; the blocks are handed out in file order
+ *
+ *        format or read errors are thrown from the reading stream
+ *
+ *****************************************************************************/
+class bgzf_streambuf :
+    public std::streambuf
+{
+public:
+    /** @brief uses std::thread::hardware_concurrency() threads if 0 */
+    explicit
+    bgzf_streambuf(const std::string& filename, unsigned threads = 0,
+                   std::size_t maxAhead = 0);
+
+    bgzf_streambuf(const bgzf_streambuf&) = delete;
+    bgzf_streambuf& operator = (const bgzf_streambuf&) = delete;
+
+    ~bgzf_streambuf();
+
+protected:
+    int_type underflow() override;
+
+private:
+    struct block {
+        std::vector<char> compressed;
+        std::vector<char> data;
+        bool ready = false;
+    };
+
+    void inflate_blocks();
+    bool read_block(block&);
+    void inflate_block(block&);
+
+    std::FILE* file_;
+    std::vector<block> blocks_;
+    std::size_t nextRead_;      //number of the next block to read
+    std::size_t nextUse_;       //number of the next block to hand out
+    std::size_t endBlock_;      //number of blocks once the file end is found
+    bool used_;                 //get area points to block 'nextUse_ - 1'
+    bool done_;
+    std::string error_;
+
+    std::mutex mutables_;
+    std::condition_variable changed_;
+    std::vector<std::thread> workers_;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief output buffer that writes BGZF to another stream buffer;
+ *        the result can be read by gzip, samtools and bgzf_streambuf
+ *
+ *        the data is cut into blocks of 65280 bytes; worker threads
+ *        compress the blocks while the producer fills the next ones and
+ *        the producer writes the compressed blocks to 'sink' in order
+ *
+ *        compression and write errors are thrown from the writing stream
+ *
+ *****************************************************************************/
+class bgzf_ostreambuf :
+    public std::streambuf
+{
+public:
+    /** @brief uses std::thread::hardware_concurrency() threads if 0;
+     *         'level' is a zlib compression level */
+    explicit
+    bgzf_ostreambuf(std::streambuf* sink, unsigned threads = 0, int level = 6);
+
+    bgzf_ostreambuf(const bgzf_ostreambuf&) = delete;
+    bgzf_ostreambuf& operator = (const bgzf_ostreambuf&) = delete;
+
+    /** @brief closes the stream; errors are ignored */
+    ~bgzf_ostreambuf();
+
+    /** @brief writes the remaining data and the end-of-file marker block */
+    void close();
+
+protected:
+    int_type overflow(int_type) override;
+    /** @brief writes all complete and the current partial block */
+    int sync() override;
+
+private:
+    struct block {
+        std::vector<char> data;
+        std::size_t size = 0;
+        std::vector<char> compressed;
+        bool ready = false;
+    };
+
+    void compress_blocks();
+    void submit();
+    void write_blocks(std::size_t end);
+
+    std::streambuf* sink_;
+    int level_;
+    std::vector<block> blocks_;
+    std::size_t nextFill_;      //number of the block in the put area
+    std::size_t nextCompress_;  //number of the next block to compress
+    std::size_t nextWrite_;     //number of the next block to write
+    bool done_;
+    bool closed_;
+    std::string error_;
+
+    std::mutex mutables_;
+    std::condition_variable changed_;
+    std::vector<std::thread> workers_;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief opens a plain, gzip or BGZF file for reading based on its content;
+ *        plain and gzip files are read ahead on a background thread;
+ *        "-" opens the standard input, compressed or not;
+ *        returns nullptr if the file can't be opened
+ *
+ *****************************************************************************/
+std::unique_ptr<std::streambuf>
+open_sequence_file(const std::string& filename);
+
+
+} // namespace anyseq
+
+
+#endif
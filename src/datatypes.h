@@ -8,8 +8,7 @@
 using index_t = std::uint64_t;
 
 
-/// @brief score storage type
-// using score_t = std::int16_t;
-// using score_t = std::int32_t;
-using score_t = std::int64_t;
+/// @brief score type returned by the Impala entry points;
+///        must match 'MatrixElem' in "dynprog.impala"
+using score_t = std::int32_t;
 
@@ -0,0 +1,250 @@
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "host_memory.h"
+
+
+namespace anyseq {
+
+namespace {
+
+//-------------------------------------------------------------------
+constexpr std::int64_t heap_alignment = 64;
+constexpr int mpol_interleave = 3;   //from <numaif.h>
+
+
+std::atomic<int>& pages_setting()
+{
+    static std::atomic<int> pages{-1};
+    return pages;
+}
+
+std::atomic<int>& numa_setting()
+{
+    static std::atomic<int> numa{-1};
+    return numa;
+}
+
+
+void init_from_environment()
+{
+    if(pages_setting() >= 0) return;
+
+    host_alloc_policy policy;
+    if(const char* env = std::getenv("ANYSEQ_HOST_ALLOC")) {
+        try {
+            policy = parse_host_alloc_policy(env);
+        }
+        catch(std::exception& e) {
+            std::cerr << "ANYSEQ_HOST_ALLOC: " << e.what() << std::endl;
+        }
+    }
+    int unset = -1;
+    numa_setting().compare_exchange_strong(unset, int(policy.numa));
+    unset = -1;
+    pages_setting().compare_exchange_strong(unset, int(policy.pages));
+}
+
+
+//-------------------------------------------------------------------
+std::int64_t mapping_size(std::int64_t size)
+{
+    return (size + host_large_buffer_size - 1) / host_large_buffer_size
+           * host_large_buffer_size;
+}
+
+
+//-------------------------------------------------------------------
+/// @brief mask of online NUMA nodes from sysfs, e.g. "0-1" or "0,2-3"
+std::vector<unsigned long> online_nodes()
+{
+    constexpr int bits = 8 * sizeof(unsigned long);
+
+    std::vector<unsigned long> mask;
+    std::ifstream is{"/sys/devices/system/node/online"};
+
+    int first = 0;
+    while(is >> first) {
+        int last = first;
+        if(is.peek() == '-') {
+            is.get();
+            is >> last;
+        }
+        for(int n = first; n <= last; ++n) {
+            if(int(mask.size()) <= n / bits) mask.resize(n / bits + 1, 0);
+            mask[n / bits] |= 1ul << (n % bits);
+        }
+        if(is.peek() == ',') is.get();
+    }
+    return mask;
+}
+
+
+void interleave(void* data, std::int64_t size)
+{
+    static const auto nodes = online_nodes();
+    if(nodes.empty()) return;
+
+    syscall(SYS_mbind, data, size, mpol_interleave,
+            nodes.data(), nodes.size() * 8 * sizeof(unsigned long) + 1, 0);
+}
+
+
+//-------------------------------------------------------------------
+void* map_pages(std::int64_t size, host_pages pages)
+{
+    void* data = MAP_FAILED;
+
+    if(pages == host_pages::explicit_huge) {
+        data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(data != MAP_FAILED) return data;
+        //no huge pages reserved
+        pages = host_pages::transparent_huge;
+    }
+
+    data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if(data == MAP_FAILED) return nullptr;
+
+    if(pages == host_pages::transparent_huge) {
+        madvise(data, size, MADV_HUGEPAGE);
+    }
+    return data;
+}
+
+} // namespace
+
+
+
+//-------------------------------------------------------------------
+host_alloc_policy parse_host_alloc_policy(const std::string& text)
+{
+    host_alloc_policy policy;
+
+    std::string::size_type begin = 0;
+    while(begin <= text.size()) {
+        auto end = text.find(',', begin);
+        if(end == std::string::npos) end = text.size();
+        const auto name = text.substr(begin, end - begin);
+
+        if(name.empty()) {}
+        else if(name == "standard")    policy.pages = host_pages::standard;
+        else if(name == "thp")         policy.pages = host_pages::transparent_huge;
+        else if(name == "hugetlb")     policy.pages = host_pages::explicit_huge;
+        else if(name == "local")       policy.numa  = numa_placement::local;
+        else if(name == "interleave")  policy.numa  = numa_placement::interleave;
+        else {
+            throw std::invalid_argument{"unknown allocation policy '" + name + "'"};
+        }
+        begin = end + 1;
+    }
+    return policy;
+}
+
+
+
+//-------------------------------------------------------------------
+host_alloc_policy current_host_alloc_policy()
+{
+    init_from_environment();
+
+    host_alloc_policy policy;
+    policy.pages = host_pages(pages_setting().load());
+    policy.numa = numa_placement(numa_setting().load());
+    return policy;
+}
+
+void current_host_alloc_policy(const host_alloc_policy& policy)
+{
+    numa_setting() = int(policy.numa);
+    pages_setting() = int(policy.pages);
+}
+
+
+
+//-------------------------------------------------------------------
+void* host_alloc(std::int64_t size)
+{
+    if(size < host_large_buffer_size) {
+        void* data = nullptr;
+        if(posix_memalign(&data, heap_alignment, size > 0 ? size : 1) != 0) {
+            throw std::bad_alloc{};
+        }
+        return data;
+    }
+
+    const auto policy = current_host_alloc_policy();
+    const auto msize = mapping_size(size);
+
+    void* data = map_pages(msize, policy.pages);
+    if(!data) throw std::bad_alloc{};
+
+    if(policy.numa == numa_placement::interleave) {
+        interleave(data, msize);
+    }
+    return data;
+}
+
+
+
+//-------------------------------------------------------------------
+void host_release(void* data, std::int64_t size)
+{
+    if(!data) return;
+
+    if(size < host_large_buffer_size) {
+        std::free(data);
+    } else {
+        munmap(data, mapping_size(size));
+    }
+}
+
+
+} // namespace anyseq
+
+
+
+//-------------------------------------------------------------------
+// C interface
+//-------------------------------------------------------------------
+void anyseq_host_set_policy(std::int32_t pages, std::int32_t numa)
+{
+    anyseq::host_alloc_policy policy;
+    policy.pages = anyseq::host_pages(pages);
+    policy.numa = anyseq::numa_placement(numa);
+    anyseq::current_host_alloc_policy(policy);
+}
+
+void* anyseq_host_alloc(std::int64_t size)
+{
+    try {
+        return anyseq::host_alloc(size);
+    }
+    catch(std::exception& e) {
+        std::cerr << "host allocation of " << size << " bytes failed: "
+                  << e.what() << std::endl;
+        std::abort();
+    }
+}
+
+void anyseq_host_release(void* data, std::int64_t size)
+{
+    anyseq::host_release(data, size);
+}
+
+void anyseq_size_error(std::int64_t size)
+{
+    std::cerr << "device allocation of " << size << " bytes failed: "
+                 "the runtime only takes 32-bit sizes" << std::endl;
+    std::abort();
+}
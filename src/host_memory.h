@@ -0,0 +1,90 @@
+#ifndef ANYSEQ_HOST_MEMORY_H_
+#define ANYSEQ_HOST_MEMORY_H_
+
+
+#include <cstdint>
+#include <string>
+
+
+namespace anyseq {
+
+
+/*************************************************************************//**
+ *
+ * @brief page size used for large host buffers
+ *
+ *****************************************************************************/
+enum class host_pages : int {
+    standard         = 0,  //whatever the system does by default
+    transparent_huge = 1,  //madvise(MADV_HUGEPAGE)
+    explicit_huge    = 2   //MAP_HUGETLB; falls back to transparent_huge
+};
+
+
+/*************************************************************************//**
+ *
+ * @brief NUMA placement of large host buffers
+ *
+ *****************************************************************************/
+enum class numa_placement : int {
+    local      = 0,  //kernel default
+    interleave = 1   //pages spread round-robin over all nodes
+};
+
+
+/*************************************************************************//**
+ *
+ * @brief allocation policy for DP buffers (score vectors, predecessor
+ *        matrices) in host memory
+ *
+ *        buffers smaller than 'host_large_buffer_size' are always
+ *        allocated with the standard heap allocator
+ *
+ *****************************************************************************/
+struct host_alloc_policy {
+    host_pages pages = host_pages::standard;
+    numa_placement numa = numa_placement::local;
+};
+
+constexpr std::int64_t host_large_buffer_size = std::int64_t(2) << 20;
+
+
+/** @brief parses a comma separated list of
+ *         "standard", "thp", "hugetlb", "local", "interleave";
+ *         throws std::invalid_argument on unknown names */
+host_alloc_policy parse_host_alloc_policy(const std::string&);
+
+/** @brief policy of subsequent allocations; initialized from the
+ *         environment variable ANYSEQ_HOST_ALLOC */
+host_alloc_policy current_host_alloc_policy();
+
+void current_host_alloc_policy(const host_alloc_policy&);
+
+
+void* host_alloc(std::int64_t size);
+
+/** @brief 'size' must be the size that was passed to host_alloc */
+void host_release(void* data, std::int64_t size);
+
+
+} // namespace anyseq
+
+
+
+extern "C" {
+
+// interface for "dynprog.impala" and "workspace.cpp"
+
+void anyseq_host_set_policy(std::int32_t pages, std::int32_t numa);
+
+void* anyseq_host_alloc(std::int64_t size);
+
+void anyseq_host_release(void* data, std::int64_t size);
+
+/// @brief aborts: 'size' bytes can't be allocated by the AnyDSL runtime
+void anyseq_size_error(std::int64_t size);
+
+}
+
+
+#endif
@@ -1,6 +1,9 @@
 #ifndef ANYSEQ_IMPALA_IMPORT_H_
 #define ANYSEQ_IMPALA_IMPORT_H_
 
+#include <climits>
+#include <cstddef>
+#include <stdexcept>
 #include <vector>
 
 #include "datatypes.h"
@@ -11,6 +14,17 @@ extern "C" {
 // functions with pre-configured scoring; defined in "export.impala"
 
 
+/// @brief result of the CIGAR entry points; coordinates are half-open
+///        ranges; layout must match the INFO_* constants in "traceback.impala"
+struct anyseq_alignment_info {
+    std::int32_t cigar_length;
+    std::int32_t query_begin;
+    std::int32_t query_end;
+    std::int32_t subject_begin;
+    std::int32_t subject_end;
+};
+
+
 score_t construct_global_alignment(
     const char* query, int lenq, 
     const char* subject, int lens, 
@@ -28,6 +42,157 @@ score_t construct_local_alignment(
 
 
 
+// full traceback with the predecessor matrix kept on disk instead of memory;
+// 'spillFile' may be empty to use an unlinked temporary file;
+// accelerator backends keep the matrix in device memory instead
+
+score_t construct_global_alignment_spilled(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    char* alQuery, char* alSubject,
+    const char* spillFile);
+
+score_t construct_semiglobal_alignment_spilled(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    char* alQuery, char* alSubject,
+    const char* spillFile);
+
+score_t construct_local_alignment_spilled(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    char* alQuery, char* alSubject,
+    const char* spillFile);
+
+
+
+/// @brief statistics of the optimal alignment; identity is
+///        matches / length; layout must match the STATS_* constants
+///        in "export.impala"
+struct anyseq_alignment_stats {
+    std::int32_t matches;
+    std::int32_t mismatches;
+    std::int32_t gaps;       //gap columns
+    std::int32_t length;
+};
+
+
+/// @brief half-open ranges of the aligned parts of both sequences; 
+///        layout must match the RANGE_* constants in "export.impala"
+struct anyseq_alignment_range {
+    std::int32_t query_begin;
+    std::int32_t query_end;
+    std::int32_t subject_begin;
+    std::int32_t subject_end;
+};
+
+
+// score-only passes that stop as soon as 'threshold' can't be reached 
+// any more; scores below the threshold are returned as 
+// anyseq::below_threshold
+
+score_t global_alignment_score_threshold(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    score_t threshold);
+
+score_t global_alignment_score_threshold_ws(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    score_t threshold,
+    void* workspace);
+
+score_t semiglobal_alignment_score_threshold(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    score_t threshold);
+
+score_t semiglobal_alignment_score_threshold_ws(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    score_t threshold,
+    void* workspace);
+
+
+// score and end coordinates from a score-only pass; 
+// the begin coordinates are set to -1 (0 for global alignments)
+
+score_t global_alignment_score_end(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    anyseq_alignment_range* range);
+
+score_t semiglobal_alignment_score_end(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    anyseq_alignment_range* range);
+
+score_t local_alignment_score_end(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    anyseq_alignment_range* range);
+
+
+// like *_score_end, but with a second score-only pass over the reversed 
+// prefixes that end in the end cell to find the begin coordinates
+
+score_t global_alignment_score_range(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    anyseq_alignment_range* range);
+
+score_t semiglobal_alignment_score_range(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    anyseq_alignment_range* range);
+
+score_t local_alignment_score_range(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    anyseq_alignment_range* range);
+
+
+
+// score and statistics from a single pass without traceback
+
+score_t global_alignment_stats(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    anyseq_alignment_stats* stats);
+
+score_t semiglobal_alignment_stats(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    anyseq_alignment_stats* stats);
+
+score_t local_alignment_stats(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    anyseq_alignment_stats* stats);
+
+
+
+// run-length encoded alignment instead of gapped strings;
+// 'cigar' must hold lenq + lens entries; each entry is encoded like in BAM:
+// run length << 4 | operation with 0 = 'M', 1 = 'I' (query), 2 = 'D' (subject)
+
+score_t global_alignment_cigar(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    std::uint32_t* cigar, anyseq_alignment_info* info);
+
+score_t semiglobal_alignment_cigar(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    std::uint32_t* cigar, anyseq_alignment_info* info);
+
+score_t local_alignment_cigar(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    std::uint32_t* cigar, anyseq_alignment_info* info);
+
+
+
 score_t global_alignment_score(
     const char* query, int lenq, 
     const char* subject, int lens);
@@ -42,6 +207,284 @@ score_t local_alignment_score(
 
 
 
+// variants that take their temporary buffers from a workspace created with
+// 'anyseq_workspace_create' (see "workspace.h"); reusing one workspace for
+// a batch of alignments avoids allocations once the pool is warm
+
+score_t construct_global_alignment_ws(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    char* alQuery, char* alSubject,
+    void* workspace);
+
+score_t construct_semiglobal_alignment_ws(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    char* alQuery, char* alSubject,
+    void* workspace);
+
+score_t construct_local_alignment_ws(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    char* alQuery, char* alSubject,
+    void* workspace);
+
+score_t global_alignment_score_ws(
+    const char* query, int lenq, 
+    const char* subject, int lens,
+    void* workspace);
+
+score_t semiglobal_alignment_score_ws(
+    const char* query, int lenq, 
+    const char* subject, int lens,
+    void* workspace);
+
+score_t local_alignment_score_ws(
+    const char* query, int lenq, 
+    const char* subject, int lens,
+    void* workspace);
+
+score_t global_alignment_stats_ws(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    anyseq_alignment_stats* stats,
+    void* workspace);
+
+score_t semiglobal_alignment_stats_ws(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    anyseq_alignment_stats* stats,
+    void* workspace);
+
+score_t local_alignment_stats_ws(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    anyseq_alignment_stats* stats,
+    void* workspace);
+
+score_t global_alignment_cigar_ws(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    std::uint32_t* cigar, anyseq_alignment_info* info,
+    void* workspace);
+
+score_t semiglobal_alignment_cigar_ws(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    std::uint32_t* cigar, anyseq_alignment_info* info,
+    void* workspace);
+
+score_t local_alignment_cigar_ws(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    std::uint32_t* cigar, anyseq_alignment_info* info,
+    void* workspace);
+
+score_t global_alignment_score_end_ws(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    anyseq_alignment_range* range,
+    void* workspace);
+
+score_t semiglobal_alignment_score_end_ws(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    anyseq_alignment_range* range,
+    void* workspace);
+
+score_t local_alignment_score_end_ws(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    anyseq_alignment_range* range,
+    void* workspace);
+
+
+
+// traceback of an alignment whose score and 'range' come from an earlier 
+// *_score_end(_ws) or *_score_range call on the same pair; the score pass 
+// is skipped and so is the search for the begin coordinates if they are
+// not -1; see also "session.h"
+
+score_t construct_semiglobal_alignment_from_range(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    score_t score, const anyseq_alignment_range* range,
+    char* alQuery, char* alSubject,
+    void* workspace);
+
+score_t construct_local_alignment_from_range(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    score_t score, const anyseq_alignment_range* range,
+    char* alQuery, char* alSubject,
+    void* workspace);
+
+score_t semiglobal_alignment_cigar_from_range(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    score_t score, const anyseq_alignment_range* range,
+    std::uint32_t* cigar, anyseq_alignment_info* info,
+    void* workspace);
+
+score_t local_alignment_cigar_from_range(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    score_t score, const anyseq_alignment_range* range,
+    std::uint32_t* cigar, anyseq_alignment_info* info,
+    void* workspace);
+
+
+
+/// @brief one of several local alignments; half-open ranges; 
+///        layout must match the HIT_* constants in "export.impala"
+struct anyseq_local_hit {
+    score_t      score;
+    std::int32_t query_begin;
+    std::int32_t query_end;
+    std::int32_t subject_begin;
+    std::int32_t subject_end;
+};
+
+// up to 'maxHits' best local alignments in decreasing order of score; 
+// no alignment contains a cell of the bounding box of a better one;
+// returns the number of alignments written to 'hits'
+
+int local_alignment_top_k(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    int maxHits, anyseq_local_hit* hits);
+
+int local_alignment_top_k_ws(
+    const char* query, int lenq, 
+    const char* subject, int lens, 
+    int maxHits, anyseq_local_hit* hits,
+    void* workspace);
+
+// top-k local alignments of a sequence with itself without the trivial
+// one on the main diagonal; every other alignment has a mirror image, 
+// so only the triangle above the diagonal is computed and all hits have
+// query_begin < subject_begin and query_end < subject_end
+
+int local_self_alignment_top_k(
+    const char* sequence, int length, 
+    int maxHits, anyseq_local_hit* hits);
+
+int local_self_alignment_top_k_ws(
+    const char* sequence, int length, 
+    int maxHits, anyseq_local_hit* hits,
+    void* workspace);
+
+
+
 }
 
+
+
+namespace anyseq {
+
+
+/// @brief result of the *_score_threshold functions for pairs that
+///        don't reach the threshold (SCORE_MIN_VALUE in "align.impala")
+constexpr score_t below_threshold = -2147483647;
+
+
+/*************************************************************************//**
+ *
+ * @brief throws std::length_error if the sequence lengths can't be passed
+ *        to the Impala entry points
+ *
+ *        the C interface and the row and column indices are 32 bit in
+ *        all builds, so lenq + lens must stay below 2^31; ANYSEQ_INDEX64
+ *        only widens the offsets into flat buffers, so that full matrices
+ *        of inputs within this limit may exceed 2^31 entries
+ *
+ *****************************************************************************/
+inline void check_lengths(std::size_t lenq, std::size_t lens)
+{
+    if(lenq + lens > std::size_t(INT_MAX)) {
+        throw std::length_error{"sequences too long for 32-bit indices"};
+    }
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief size_t based entry points; check the sequence lengths first
+ *
+ *****************************************************************************/
+namespace checked {
+
+inline score_t
+global_alignment_score(const char* query, std::size_t lenq,
+                       const char* subject, std::size_t lens)
+{
+    check_lengths(lenq, lens);
+    return ::global_alignment_score(query, int(lenq), subject, int(lens));
+}
+
+inline score_t
+semiglobal_alignment_score(const char* query, std::size_t lenq,
+                           const char* subject, std::size_t lens)
+{
+    check_lengths(lenq, lens);
+    return ::semiglobal_alignment_score(query, int(lenq), subject, int(lens));
+}
+
+inline score_t
+local_alignment_score(const char* query, std::size_t lenq,
+                      const char* subject, std::size_t lens)
+{
+    check_lengths(lenq, lens);
+    return ::local_alignment_score(query, int(lenq), subject, int(lens));
+}
+
+
+/// @brief 'alQuery' and 'alSubject' must hold lenq + lens characters
+inline score_t
+construct_global_alignment(const char* query, std::size_t lenq,
+                           const char* subject, std::size_t lens,
+                           char* alQuery, char* alSubject)
+{
+    check_lengths(lenq, lens);
+    return ::construct_global_alignment(query, int(lenq), subject, int(lens),
+                                        alQuery, alSubject);
+}
+
+inline score_t
+construct_semiglobal_alignment(const char* query, std::size_t lenq,
+                               const char* subject, std::size_t lens,
+                               char* alQuery, char* alSubject)
+{
+    check_lengths(lenq, lens);
+    return ::construct_semiglobal_alignment(query, int(lenq), subject, int(lens),
+                                            alQuery, alSubject);
+}
+
+inline score_t
+construct_local_alignment(const char* query, std::size_t lenq,
+                          const char* subject, std::size_t lens,
+                          char* alQuery, char* alSubject)
+{
+    check_lengths(lenq, lens);
+    return ::construct_local_alignment(query, int(lenq), subject, int(lens),
+                                       alQuery, alSubject);
+}
+
+
+/// @brief 'hits' must hold 'maxHits' entries
+inline int
+local_self_alignment_top_k(const char* sequence, std::size_t length,
+                           int maxHits, anyseq_local_hit* hits)
+{
+    check_lengths(length, length);
+    return ::local_self_alignment_top_k(sequence, int(length), maxHits, hits);
+}
+
+} // namespace checked
+
+
+} // namespace anyseq
+
+
 #endif
@@ -10,7 +10,11 @@
 
 #include "import.h"         //AnySeq C interface
 #include "alignment_io.h"
+#include "host_memory.h"
+#include "pipeline.h"
 #include "sequence_io.h"
+#include "session.h"
+#include "tile_pruning.h"
 #include "timer.h"  
 #include "clipp.h"          //command line args handling
 
@@ -56,18 +60,71 @@ void benchmark_score(const std::string& name,
     os << " " << time.milliseconds() << " ms" << std::endl;
 }
 
+//-------------------------------------------------------------------
+void benchmark_session(const std::string& name, alignment_kind kind,
+                       const std::string& q, const std::string& s,
+                       std::ostream& os)
+{
+    os << "testing " << name << std::flush;
+
+    std::string alq;
+    std::string als;
+
+    am::timer time;
+    time.start();
+    alignment_session session{kind, q, s};
+    session.score();
+    volatile auto score = session.alignment(alq, als);
+    time.stop();
+    (void)score;
+
+    os << " " << time.milliseconds() << " ms" << std::endl;
+}
+
+
+//-------------------------------------------------------------------
+void benchmark_self_hits(const std::string& name, int maxHits,
+                         const std::string& q, std::ostream& os)
+{
+    os << "testing " << name << std::flush;
+
+    std::vector<anyseq_local_hit> hits(maxHits);
+
+    am::timer time;
+    time.start();
+    volatile auto count = checked::local_self_alignment_top_k(
+                              q.c_str(), q.size(), maxHits, hits.data());
+    time.stop();
+    (void)count;
+
+    os << " " << time.milliseconds() << " ms" << std::endl;
+}
+
+
+//-------------------------------------------------------------------
+void print_tile_pruning(const tile_pruning_statistics& stats, std::ostream& os)
+{
+    if(stats.blocks < 1) return;
+    os << "  skipped " << stats.skipped << " of " << stats.blocks
+       << " blocks, " << stats.reruns << " of " << stats.alignments
+       << " scores recomputed" << std::endl;
+}
+
+
 //-------------------------------------------------------------------
 void benchmark_alignments(const std::string& q, const std::string& s,
                           std::ostream& os)
 {
     benchmark_score("global score", 
-        global_alignment_score, q, s, os);
+        checked::global_alignment_score, q, s, os);
 
     benchmark_score("semiglobal score",
-        semiglobal_alignment_score, q, s, os);
+        checked::semiglobal_alignment_score, q, s, os);
 
+    reset_tile_pruning_totals();
     benchmark_score("local score",
-        local_alignment_score, q, s, os);
+        checked::local_alignment_score, q, s, os);
+    print_tile_pruning(tile_pruning_totals(), os);
 
 
     const auto alen = q.size() + s.size();
@@ -76,13 +133,21 @@ void benchmark_alignments(const std::string& q, const std::string& s,
     std::string als; als.resize(alen, ' ');
 
     benchmark_align("global alignment", 
-        construct_global_alignment, q, s, alq, als, os);
+        checked::construct_global_alignment, q, s, alq, als, os);
 
     benchmark_align("semiglobal alignment",
-    construct_semiglobal_alignment, q, s, alq, als, os);
+    checked::construct_semiglobal_alignment, q, s, alq, als, os);
 
     benchmark_align("local alignment",
-        construct_local_alignment, q, s, alq, als, os);
+        checked::construct_local_alignment, q, s, alq, als, os);
+
+    benchmark_session("local session (score + alignment)",
+        alignment_kind::local, q, s, os);
+
+    //only one triangle of a self-comparison needs to be computed
+    if(q == s) {
+        benchmark_self_hits("local self alignment (top 10)", 10, q, os);
+    }
 }
 
 
@@ -120,6 +185,39 @@ std::string random_string(std::size_t minlen, std::size_t maxlen, URNG& urng)
 }
 
 
+//-------------------------------------------------------------------
+alignment_kind parse_alignment_kind(const std::string& name)
+{
+    if(name == "global")     return alignment_kind::global;
+    if(name == "semiglobal") return alignment_kind::semiglobal;
+    if(name == "local")      return alignment_kind::local;
+    throw std::invalid_argument{"unknown alignment kind " + name};
+}
+
+
+
+//-------------------------------------------------------------------
+std::string fetch_region(const std::string& filename, const std::string& region)
+{
+    if(packed_sequences::is_packed(filename)) {
+        return packed_sequences{filename}.fetch_region(region);
+    }
+    return indexed_fasta{filename}.fetch_region(region);
+}
+
+
+
+//-------------------------------------------------------------------
+void print_readahead(const readahead_statistics& stats, std::ostream& os)
+{
+    if(stats.buffers < 1) return;
+    os << "input read ahead: " << stats.buffers << " buffers, "
+       << (stats.readMicroseconds / 1000.0) << " ms reading, "
+       << (stats.waitMicroseconds / 1000.0) << " ms waiting" << std::endl;
+}
+
+
+
 //-------------------------------------------------------------------
 int main(int argc, char* argv[]) 
 {
@@ -127,7 +225,7 @@ int main(int argc, char* argv[])
     using std::cout;
     using std::endl;
 
-    enum class imode { file, args, stdio, random };
+    enum class imode { file, args, stdio, random, pack, stream, all };
     enum class omode { file, stdio };
     auto input = imode::file;
     auto output = omode::stdio;
@@ -135,31 +233,84 @@ int main(int argc, char* argv[])
     std::int64_t maxlen = 1024;
     std::string query, subject;
     std::string outfile;
+    std::string allocPolicy;
+    std::string queryRegion, subjectRegion;
+    std::string kind = "global";
+    bool paired = false;
+    bool gzipped = false;
+    std::string format = "tab";
+    pipeline_options streaming;
+    alignment_cache_options caching;
+    std::size_t cacheMiB = caching.memoryLimit >> 20;
     std::vector<std::string> wrong;
 
     auto cli = (
-        // (option("-o", "--out").set(output,omode::file) & 
-        //  value("file", outfile)) % "write results to file"
-        // ,
+        (option("-o", "--out").set(output,omode::file) & 
+         value("file", outfile)) % "write results to file; streaming output "
+                                   "is BGZF compressed if the name ends with .gz"
+        ,
         "read sequences from input files" % (
             command("-i", "--in"),
             value("query file", query),
-            value("subject file", subject)
+            value("subject file", subject),
+            (option("--query-region") & value("region", queryRegion)) %
+                "query record 'name' or 'name:begin-end' (1-based) "
+                "instead of the first one; uses/creates a .fai index "
+                "unless the file is packed",
+            (option("--subject-region") & value("region", subjectRegion)) %
+                "subject record, see --query-region"
         ) | 
         // "specify sequences on the command line" % (
         //     command("-a", "--args").set(input,imode::args),
         //     value("query string", query),
         //     value("subject string", subject)
         // ) | 
+        "align each query with each reference record in a streaming "
+        "pipeline; '-' reads one of the files from stdin" % (
+            command("-s", "--stream").set(input,imode::stream),
+            value("query file", query),
+            value("reference file", subject),
+            option("--paired").set(paired) %
+                "align the i-th query with the i-th reference record instead"
+        ) |
+        "align all pairs of different records within one file" % (
+            command("-A", "--all-vs-all").set(input,imode::all),
+            value("sequence file", query)
+        ) |
+        "align records 1+2, 3+4, ... read from stdin (FASTA/FASTQ, gzip)" % (
+            command("-").set(input,imode::stdio)
+        ) |
+        "convert sequences to a packed 2-bit file" % (
+            command("-p", "--pack").set(input,imode::pack),
+            value("sequence file", query),
+            value("packed file", subject)
+        ) |
         "generate random input sequences" % (
             command("-r", "--rand").set(input,imode::random),
             opt_integer("min len", minlen) &
             opt_integer("max len", maxlen)
         ),
-        // | ( 
-        // "read sequences from stdin" %
-        //     command("-").set(input,imode::stdio)
-        // )
+        "streaming options" % (
+            (option("-k", "--kind") & value("global|semiglobal|local", kind)) %
+                "alignment kind (default: global)",
+            (option("-t", "--threads") & value("n", streaming.workers)) %
+                "alignment threads (default: all cores)",
+            option("--score-only").set(streaming.traceback,false) %
+                "skip the traceback (tabular output only)",
+            (option("-f", "--format") & value("tab|sam|paf|blast", format)) %
+                "output format (default: tab)",
+            option("-z", "--gzip").set(gzipped) %
+                "write BGZF compressed output with all cores",
+            (option("--cache") & value("file", caching.filename)) %
+                "reuse alignment results stored in this file and add new ones",
+            (option("--cache-mem") & value("MiB", cacheMiB)) %
+                "memory for alignment results (default: 256; 0 disables)",
+            option("--no-dedup").set(streaming.deduplicate,false) %
+                "align identical pairs within a batch separately"
+        ),
+        (option("-m", "--mem") & value("policy", allocPolicy)) % 
+            "host memory policy for DP buffers; comma separated list of "
+            "standard|thp|hugetlb and local|interleave",
         any_other(wrong)
     );
 
@@ -173,19 +324,132 @@ int main(int argc, char* argv[])
         return 0;
     }
 
+    if(!allocPolicy.empty()) {
+        try {
+            current_host_alloc_policy(parse_host_alloc_policy(allocPolicy));
+        }
+        catch(std::exception& e) {
+            std::cerr << e.what() << endl;
+            return 1;
+        }
+    }
+
     switch(input) {
+        case imode::stream:
+        case imode::all:
+        case imode::stdio:
+            try {
+                streaming.kind = parse_alignment_kind(kind);
+                const auto outputFormat = parse_alignment_format(format);
+                if(!streaming.traceback && outputFormat != alignment_format::tabular) {
+                    std::cerr << "--score-only requires tabular output (-f tab)!" << endl;
+                    return 1;
+                }
+                auto formatter = make_alignment_formatter(outputFormat);
+
+                std::ofstream file;
+                std::streambuf* sink = cout.rdbuf();
+                if(output == omode::file) {
+                    file.open(outfile, std::ios::binary);
+                    if(!file.good()) {
+                        std::cerr << "Unable to open output file!" << endl;
+                        return 1;
+                    }
+                    sink = file.rdbuf();
+                    const auto n = outfile.size();
+                    if(n > 3 && outfile.compare(n - 3, 3, ".gz") == 0) gzipped = true;
+                }
+                std::unique_ptr<bgzf_ostreambuf> zbuf;
+                if(gzipped) zbuf.reset(new bgzf_ostreambuf{sink});
+                std::ostream os{zbuf ? zbuf.get() : sink};
+                os.exceptions(std::ios::badbit);
+
+                caching.memoryLimit = cacheMiB << 20;
+                std::unique_ptr<alignment_cache> cache;
+                if(caching.memoryLimit > 0 || !caching.filename.empty()) {
+                    cache.reset(new alignment_cache{caching});
+                    streaming.cache = cache.get();
+                }
+
+                //one process and one set of buffers for all pairs
+                pipeline_statistics stats;
+                if(input == imode::all) {
+                    const sequence_records records{query};
+                    stats = align_all_pairs(records, *formatter, os, streaming);
+                }
+                else if(input == imode::stdio) {
+                    auto reader = make_sequence_reader("-");
+                    stats = align_interleaved(*reader, *formatter, os, streaming);
+                }
+                else {
+                    if(query == "-" && subject == "-") {
+                        std::cerr << "Only one input can be read from stdin!" << endl;
+                        return 1;
+                    }
+                    auto qreader = make_sequence_reader(query);
+                    if(paired) {
+                        auto sreader = make_sequence_reader(subject);
+                        stats = align_pairs(*qreader, *sreader, *formatter, os, streaming);
+                    } else {
+                        const sequence_records reference{subject};
+                        stats = align_against_reference(*qreader, reference, *formatter, os, streaming);
+                    }
+                }
+                if(zbuf) zbuf->close();
+                os.flush();
+                if(cache) cache->flush();
+                std::cerr << stats.pairs << " alignments in "
+                          << (stats.microseconds / 1000.0) << " ms" << endl;
+                if(cache || streaming.deduplicate) {
+                    std::cerr << "duplicates: " << stats.duplicates
+                              << ", cache hits: " << stats.cacheHits
+                              << ", cache misses: " << stats.cacheMisses << endl;
+                }
+            }
+            catch(std::exception& e) {
+                std::cerr << e.what() << endl;
+                return 1;
+            }
+            return 0;
+        case imode::pack:
+            try {
+                am::timer time;
+                time.start();
+                packed_sequences::convert(query, subject);
+                time.stop();
+                packed_sequences packed{subject};
+                cout << "packed " << packed.size() << " sequences with "
+                     << packed.total_bases() << " bases into " << subject
+                     << " in " << time.milliseconds() << " ms" << endl;
+            }
+            catch(std::exception& e) {
+                std::cerr << e.what() << endl;
+                return 1;
+            }
+            return 0;
         default:
         case imode::file:
             cout << "input sequences: " << query << ", " << subject << endl;
             try {
                 //only use first sequence from each input files 
-                auto qreader = make_sequence_reader(query);
-                if(qreader->has_next()) {
-                    query = std::move(qreader->next().data);
+                //unless a record is selected
+                if(!queryRegion.empty()) {
+                    query = fetch_region(query, queryRegion);
+                } else {
+                    auto qreader = make_sequence_reader(query);
+                    if(qreader->has_next()) {
+                        query = std::move(qreader->next().data);
+                    }
+                    print_readahead(qreader->io_statistics(), cout);
                 }
-                auto sreader = make_sequence_reader(subject);
-                if(sreader->has_next()) {
-                    subject = std::move(sreader->next().data);
+                if(!subjectRegion.empty()) {
+                    subject = fetch_region(subject, subjectRegion);
+                } else {
+                    auto sreader = make_sequence_reader(subject);
+                    if(sreader->has_next()) {
+                        subject = std::move(sreader->next().data);
+                    }
+                    print_readahead(sreader->io_statistics(), cout);
                 }
             } 
             catch(std::exception& e) {
@@ -194,9 +458,6 @@ int main(int argc, char* argv[])
             break;
         case imode::args:
             break; //data already in variables
-        case imode::stdio:
-            std::cin >> query >> subject;
-            break;
         case imode::random: {
             if(minlen < 1 || maxlen < 1) {
                 std::cerr << "String lenghts must be greater than zero!" << endl;
@@ -0,0 +1,681 @@
+#include <algorithm>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "alignment_io.h"
+#include "bounded_queue.h"
+#include "io_error.h"
+#include "pipeline.h"
+#include "timer.h"
+#include "workspace.h"
+
+
+namespace anyseq {
+
+using std::string;
+
+
+namespace {
+
+//-------------------------------------------------------------------
+struct pair_result {
+    score_t score;
+    anyseq_alignment_info info;
+    std::size_t cigarOffset;
+};
+
+
+//-------------------------------------------------------------------
+/// @brief unit of work that goes from the reader over a worker
+///        to the writer and back to the reader
+struct pipeline_batch {
+    std::uint64_t number = 0;       //batch number in input order
+    std::uint64_t firstPair = 0;
+    sequence_reader::batch queries;
+    sequence_reader::batch subjects;    //paired input only
+    std::vector<std::pair<std::size_t,std::size_t>> pairs;  //all-vs-all only
+    std::vector<pair_result> results;
+    std::vector<std::uint32_t> cigars;
+    std::string text;                   //formatted output
+    std::uint64_t duplicates = 0;
+    std::uint64_t cacheHits = 0;
+    std::uint64_t cacheMisses = 0;
+};
+
+using batch_ptr = std::unique_ptr<pipeline_batch>;
+
+/// @brief fills a batch; returns false at the end of the input
+using batch_source = std::function<bool(pipeline_batch&)>;
+
+
+//-------------------------------------------------------------------
+/// @brief records are either passed to 'writer' one by one by the writer
+///        stage or formatted by the workers and written to 'os'
+struct pipeline_output {
+    const pipeline_writer* writer = nullptr;
+    const alignment_formatter* format = nullptr;
+    std::ostream* os = nullptr;
+};
+
+
+//-------------------------------------------------------------------
+struct sequence_view {
+    const char* header;
+    std::size_t headerSize;
+    const char* data;
+    std::size_t size;
+    const char* qualities;
+    std::size_t qualitiesSize;
+};
+
+sequence_view view(const sequence_reader::batch& b, std::size_t i) noexcept
+{
+    return sequence_view{b.header(i), b.header_size(i), b.data(i), b.data_size(i),
+                         b.qualities(i), b.qualities_size(i)};
+}
+
+sequence_view view(const sequence_records::record& r) noexcept
+{
+    return sequence_view{r.header, r.header_size, r.data, r.size,
+                         r.qualities, r.qualities_size};
+}
+
+/// @brief sequence i of a batch or record i of the reference / all records
+///        if the batch is null
+using batch_entry = std::pair<const sequence_reader::batch*,std::size_t>;
+
+constexpr batch_entry no_entry{nullptr, std::size_t(-1)};
+
+
+//-------------------------------------------------------------------
+/// @brief buffers of one alignment thread
+struct worker_state {
+    workspace ws;
+    std::vector<std::uint32_t> cigar;
+    //first pair of the current batch for each key
+    std::unordered_map<content_hash,std::size_t,content_hash_hasher> unique;
+};
+
+
+/// @brief which sequences of a batch form pair k
+enum class pairing {
+    reference,  //query k / R with reference record k % R
+    paired,     //query k with subject k
+    all         //records pairs[k].first and pairs[k].second
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief reader thread -> worker threads -> writer (calling thread)
+ *
+ *        'free_' holds the batches that are not in use; the reader has
+ *        to take one before it can read on, which bounds the memory
+ *        and the number of batches that wait for the writer's turn
+ *
+ *****************************************************************************/
+class pipeline
+{
+public:
+    /** @brief 'records' holds the reference records or all records */
+    pipeline(const pipeline_options& opt, pairing pairs,
+             const sequence_records* records, const pipeline_output& out):
+        opt_{opt},
+        pairing_{pairs},
+        records_{records},
+        out_{out},
+        workers_{opt.workers > 0 ? opt.workers
+                                 : std::max(1u, std::thread::hardware_concurrency())},
+        batches_{opt.batches > 0 ? opt.batches : 4 * std::size_t(workers_)},
+        free_{batches_}, work_{batches_}, done_{batches_},
+        keyed_{opt.deduplicate || opt.cache},
+        recordHashes_{},
+        active_{0}, failed_{false},
+        errorMutex_{}, error_{}
+    {
+        //the records take part in many pairs
+        if(keyed_ && records_) {
+            recordHashes_.reserve(records_->size());
+            for(const auto& r : *records_) {
+                recordHashes_.push_back(hash_content(r.data, r.size));
+            }
+        }
+    }
+
+    pipeline_statistics run(const batch_source&);
+
+private:
+    std::size_t pairs(const pipeline_batch& b) const noexcept {
+        switch(pairing_) {
+            case pairing::reference: return b.queries.size() * records_->size();
+            case pairing::all:       return b.pairs.size();
+            default:                 return b.queries.size();
+        }
+    }
+    batch_entry query(const pipeline_batch& b, std::size_t k) const noexcept {
+        switch(pairing_) {
+            case pairing::reference: return {&b.queries, k / records_->size()};
+            case pairing::all:       return {nullptr, b.pairs[k].first};
+            default:                 return {&b.queries, k};
+        }
+    }
+    batch_entry subject(const pipeline_batch& b, std::size_t k) const noexcept {
+        switch(pairing_) {
+            case pairing::reference: return {nullptr, k % records_->size()};
+            case pairing::all:       return {nullptr, b.pairs[k].second};
+            default:                 return {&b.subjects, k};
+        }
+    }
+    sequence_view view(const batch_entry& e) const noexcept {
+        return e.first ? anyseq::view(*e.first, e.second)
+                       : anyseq::view((*records_)[e.second]);
+    }
+    content_hash hash(const batch_entry& e) const noexcept {
+        if(!e.first) return recordHashes_[e.second];
+        return hash_content(e.first->data(e.second), e.first->data_size(e.second));
+    }
+    alignment_record record(const pipeline_batch&, std::size_t k) const noexcept;
+
+    void read(const batch_source&);
+    void align();
+    void align(pipeline_batch&, worker_state&) const;
+    void write(const pipeline_batch&) const;
+    void fail();
+
+    pipeline_options opt_;
+    pairing pairing_;
+    const sequence_records* records_;
+    pipeline_output out_;
+    unsigned workers_;
+    std::size_t batches_;
+    bounded_queue<batch_ptr> free_;
+    bounded_queue<batch_ptr> work_;
+    bounded_queue<batch_ptr> done_;
+    bool keyed_;
+    std::vector<content_hash> recordHashes_;
+    std::atomic<unsigned> active_;
+    std::atomic<bool> failed_;
+    std::mutex errorMutex_;
+    std::exception_ptr error_;
+};
+
+
+
+//-------------------------------------------------------------------
+pipeline_statistics
+pipeline::run(const batch_source& source)
+{
+    am::timer time;
+    time.start();
+
+    for(std::size_t i = 0; i < batches_; ++i) {
+        free_.push(batch_ptr{new pipeline_batch{}});
+    }
+
+    active_ = workers_;
+    std::vector<std::thread> threads;
+    threads.emplace_back([&] { read(source); });
+    for(unsigned i = 0; i < workers_; ++i) {
+        threads.emplace_back([this] { align(); });
+    }
+
+    //results are written in batch order
+    pipeline_statistics stats;
+    std::map<std::uint64_t,batch_ptr> pending;
+    batch_ptr b;
+    while(done_.pop(b)) {
+        pending.emplace(b->number, std::move(b));
+
+        for(auto i = pending.find(stats.batches); i != pending.end();
+            i = pending.find(stats.batches))
+        {
+            if(!failed_) {
+                try {
+                    const auto& done = *i->second;
+                    write(done);
+                    stats.pairs += pairs(done);
+                    stats.duplicates += done.duplicates;
+                    stats.cacheHits += done.cacheHits;
+                    stats.cacheMisses += done.cacheMisses;
+                }
+                catch(...) {
+                    fail();
+                }
+            }
+            ++stats.batches;
+            free_.push(std::move(i->second));
+            pending.erase(i);
+        }
+    }
+
+    for(auto& t : threads) t.join();
+
+    time.stop();
+    stats.microseconds = time.microseconds();
+
+    if(error_) std::rethrow_exception(error_);
+    return stats;
+}
+
+
+
+//-------------------------------------------------------------------
+void pipeline::read(const batch_source& source)
+{
+    std::uint64_t number = 0;
+    std::uint64_t firstPair = 0;
+    batch_ptr b;
+
+    while(!failed_ && free_.pop(b)) {
+        bool more = false;
+        try {
+            more = source(*b);
+        }
+        catch(...) {
+            fail();
+        }
+        if(!more) break;
+
+        b->number = number++;
+        b->firstPair = firstPair;
+        firstPair += pairs(*b);
+        work_.push(std::move(b));
+    }
+    work_.close();
+}
+
+
+
+//-------------------------------------------------------------------
+void pipeline::align()
+{
+    worker_state state;
+    batch_ptr b;
+
+    while(work_.pop(b)) {
+        if(!failed_) {
+            try {
+                align(*b, state);
+            }
+            catch(...) {
+                fail();
+            }
+        }
+        //the writer waits for every batch number
+        done_.push(std::move(b));
+    }
+    if(--active_ == 0) done_.close();
+}
+
+
+
+//-------------------------------------------------------------------
+void pipeline::align(pipeline_batch& b, worker_state& state) const
+{
+    const auto n = pairs(b);
+    b.results.resize(n);
+    b.cigars.clear();
+    b.duplicates = 0;
+    b.cacheHits = 0;
+    b.cacheMisses = 0;
+    state.unique.clear();
+
+    auto& cigar = state.cigar;
+    batch_entry lastQuery = no_entry;
+    content_hash queryHash;
+
+    for(std::size_t k = 0; k < n; ++k) {
+        const auto qe = query(b, k);
+        const auto se = subject(b, k);
+        auto& r = b.results[k];
+
+        content_hash key;
+        if(keyed_) {
+            //consecutive pairs often share the query
+            if(qe != lastQuery) {
+                queryHash = hash(qe);
+                lastQuery = qe;
+            }
+            key = alignment_key(opt_.kind, opt_.traceback, queryHash, hash(se));
+
+            if(opt_.deduplicate) {
+                const auto first = state.unique.emplace(key, k);
+                if(!first.second) {
+                    //shares the CIGAR of the first pair
+                    r = b.results[first.first->second];
+                    ++b.duplicates;
+                    continue;
+                }
+            }
+            if(opt_.cache) {
+                if(opt_.cache->find(key, r.score, r.info, cigar)) {
+                    r.cigarOffset = b.cigars.size();
+                    b.cigars.insert(b.cigars.end(), cigar.begin(), cigar.end());
+                    ++b.cacheHits;
+                    continue;
+                }
+                ++b.cacheMisses;
+            }
+        }
+
+        const auto q = view(qe);
+        const auto s = view(se);
+        alignment_session session{opt_.kind, q.data, q.size, s.data, s.size, &state.ws};
+
+        r.cigarOffset = b.cigars.size();
+        if(opt_.traceback) {
+            r.score = session.cigar(cigar, r.info);
+            b.cigars.insert(b.cigars.end(), cigar.begin(), cigar.end());
+        }
+        else {
+            r.score = session.score();
+            if(opt_.kind == alignment_kind::global) {
+                r.info = anyseq_alignment_info{0, 0, int(q.size), 0, int(s.size)};
+            } else {
+                const auto& range = session.range();
+                r.info = anyseq_alignment_info{0,
+                    range.query_begin, range.query_end,
+                    range.subject_begin, range.subject_end};
+            }
+        }
+        if(opt_.cache) {
+            opt_.cache->insert(key, r.score, r.info, b.cigars.data() + r.cigarOffset);
+        }
+    }
+
+    //formatting is spread over the workers, too
+    if(out_.format) {
+        b.text.clear();
+        for(std::size_t k = 0; k < n; ++k) {
+            out_.format->format(record(b, k), b.text);
+        }
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+alignment_record
+pipeline::record(const pipeline_batch& b, std::size_t k) const noexcept
+{
+    const auto qe = query(b, k);
+    const auto se = subject(b, k);
+    const auto q = view(qe);
+    const auto s = view(se);
+    const auto& r = b.results[k];
+
+    return alignment_record{
+        b.firstPair + k,
+        q.header, q.headerSize, q.data, q.size,
+        q.qualities, q.qualitiesSize,
+        s.header, s.headerSize, s.data, s.size,
+        r.score, r.info, b.cigars.data() + r.cigarOffset};
+}
+
+
+
+//-------------------------------------------------------------------
+void pipeline::write(const pipeline_batch& b) const
+{
+    if(out_.format) {
+        out_.os->write(b.text.data(), std::streamsize(b.text.size()));
+        return;
+    }
+    const auto n = pairs(b);
+    for(std::size_t k = 0; k < n; ++k) {
+        (*out_.writer)(record(b, k));
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+/// @brief keeps the first exception and lets all stages run dry
+void pipeline::fail()
+{
+    std::lock_guard<std::mutex> lock(errorMutex_);
+    if(!error_) error_ = std::current_exception();
+    failed_ = true;
+}
+
+
+} // namespace
+
+
+
+//-------------------------------------------------------------------
+namespace {
+
+//-------------------------------------------------------------------
+void write_header(const pipeline_output& out, const sequence_records* records)
+{
+    if(!out.format) return;
+    string text;
+    out.format->header(records, text);
+    out.os->write(text.data(), std::streamsize(text.size()));
+}
+
+
+//-------------------------------------------------------------------
+pipeline_statistics
+run_against_reference(sequence_reader& queries, const sequence_records& records,
+                      const pipeline_output& out, const pipeline_options& opt)
+{
+    write_header(out, &records);
+    if(records.empty()) return pipeline_statistics{};
+
+    const auto n = std::max(std::size_t(1), opt.batchSize / records.size());
+    batch_prefetcher prefetch{queries, n};
+
+    return pipeline{opt, pairing::reference, &records, out}.run(
+        [&](pipeline_batch& b) { return prefetch.next_batch(b.queries) > 0; });
+}
+
+
+//-------------------------------------------------------------------
+pipeline_statistics
+run_pairs(sequence_reader& queries, sequence_reader& subjects,
+          const pipeline_output& out, const pipeline_options& opt)
+{
+    write_header(out, nullptr);
+
+    //both inputs are parsed at the same time
+    const auto n = std::max(std::size_t(1), opt.batchSize);
+    batch_prefetcher prefetchQueries{queries, n};
+    batch_prefetcher prefetchSubjects{subjects, n};
+
+    return pipeline{opt, pairing::paired, nullptr, out}.run(
+        [&](pipeline_batch& b) {
+            const auto nq = prefetchQueries.next_batch(b.queries);
+            const auto ns = prefetchSubjects.next_batch(b.subjects);
+            if(nq != ns) {
+                throw io_format_error{"paired inputs have different numbers of records"};
+            }
+            return nq > 0;
+        });
+}
+
+
+
+//-------------------------------------------------------------------
+pipeline_statistics
+run_all_pairs(const sequence_records& records,
+              const pipeline_output& out, const pipeline_options& opt)
+{
+    write_header(out, &records);
+
+    const auto n = std::max(std::size_t(1), opt.batchSize);
+    std::size_t i = 0;
+    std::size_t j = 1;
+
+    return pipeline{opt, pairing::all, &records, out}.run(
+        [&](pipeline_batch& b) {
+            //pairs i < j in row order
+            b.pairs.clear();
+            while(b.pairs.size() < n && i + 1 < records.size()) {
+                b.pairs.emplace_back(i, j);
+                if(++j == records.size()) {
+                    ++i;
+                    j = i + 1;
+                }
+            }
+            return !b.pairs.empty();
+        });
+}
+
+
+//-------------------------------------------------------------------
+pipeline_statistics
+run_interleaved(sequence_reader& reader,
+                const pipeline_output& out, const pipeline_options& opt)
+{
+    write_header(out, nullptr);
+
+    const auto n = std::max(std::size_t(1), opt.batchSize);
+    batch_prefetcher prefetch{reader, 2 * n};
+    sequence_reader::batch records;
+
+    return pipeline{opt, pairing::paired, nullptr, out}.run(
+        [&](pipeline_batch& b) {
+            prefetch.next_batch(records);
+            if(records.size() % 2 != 0) {
+                throw io_format_error{"interleaved input has an odd number of records"};
+            }
+            b.queries.clear();
+            b.subjects.clear();
+            for(std::size_t i = 0; i < records.size(); i += 2) {
+                b.queries.push_back(records, i);
+                b.subjects.push_back(records, i + 1);
+            }
+            return !b.queries.empty();
+        });
+}
+
+} // namespace
+
+
+
+//-------------------------------------------------------------------
+pipeline_statistics
+align_against_reference(sequence_reader& queries, const sequence_records& reference,
+                        const pipeline_writer& write,
+                        const pipeline_options& opt)
+{
+    pipeline_output out;
+    out.writer = &write;
+    return run_against_reference(queries, reference, out, opt);
+}
+
+
+//-------------------------------------------------------------------
+pipeline_statistics
+align_against_reference(sequence_reader& queries, const sequence_records& reference,
+                        const alignment_formatter& format, std::ostream& os,
+                        const pipeline_options& opt)
+{
+    pipeline_output out;
+    out.format = &format;
+    out.os = &os;
+    return run_against_reference(queries, reference, out, opt);
+}
+
+
+
+//-------------------------------------------------------------------
+pipeline_statistics
+align_pairs(sequence_reader& queries, sequence_reader& subjects,
+            const pipeline_writer& write,
+            const pipeline_options& opt)
+{
+    pipeline_output out;
+    out.writer = &write;
+    return run_pairs(queries, subjects, out, opt);
+}
+
+
+//-------------------------------------------------------------------
+pipeline_statistics
+align_pairs(sequence_reader& queries, sequence_reader& subjects,
+            const alignment_formatter& format, std::ostream& os,
+            const pipeline_options& opt)
+{
+    pipeline_output out;
+    out.format = &format;
+    out.os = &os;
+    return run_pairs(queries, subjects, out, opt);
+}
+
+
+
+//-------------------------------------------------------------------
+pipeline_statistics
+align_all_pairs(const sequence_records& records, const pipeline_writer& write,
+                const pipeline_options& opt)
+{
+    pipeline_output out;
+    out.writer = &write;
+    return run_all_pairs(records, out, opt);
+}
+
+
+//-------------------------------------------------------------------
+pipeline_statistics
+align_all_pairs(const sequence_records& records,
+                const alignment_formatter& format, std::ostream& os,
+                const pipeline_options& opt)
+{
+    pipeline_output out;
+    out.format = &format;
+    out.os = &os;
+    return run_all_pairs(records, out, opt);
+}
+
+
+
+//-------------------------------------------------------------------
+pipeline_statistics
+align_interleaved(sequence_reader& records, const pipeline_writer& write,
+                  const pipeline_options& opt)
+{
+    pipeline_output out;
+    out.writer = &write;
+    return run_interleaved(records, out, opt);
+}
+
+
+//-------------------------------------------------------------------
+pipeline_statistics
+align_interleaved(sequence_reader& records,
+                  const alignment_formatter& format, std::ostream& os,
+                  const pipeline_options& opt)
+{
+    pipeline_output out;
+    out.format = &format;
+    out.os = &os;
+    return run_interleaved(records, out, opt);
+}
+
+
+
+//-------------------------------------------------------------------
+pipeline_writer tabular_writer(std::ostream& os)
+{
+    auto format = std::shared_ptr<alignment_formatter>{
+        make_alignment_formatter(alignment_format::tabular)};
+    auto text = std::make_shared<string>();
+
+    return [&os,format,text](const alignment_record& a) {
+        text->clear();
+        format->format(a, *text);
+        os.write(text->data(), std::streamsize(text->size()));
+    };
+}
+
+
+} // namespace anyseq
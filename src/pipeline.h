@@ -0,0 +1,158 @@
+#ifndef ANYSEQ_PIPELINE_H_
+#define ANYSEQ_PIPELINE_H_
+
+
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+
+#include "alignment_cache.h"
+#include "alignment_io.h"
+#include "import.h"
+#include "sequence_io.h"
+#include "session.h"
+
+
+namespace anyseq {
+
+
+/*************************************************************************//**
+ *
+ * @brief settings of the streaming alignment driver
+ *
+ *****************************************************************************/
+struct pipeline_options {
+    alignment_kind kind = alignment_kind::global;
+    /** @brief compute CIGARs and begin coordinates, not only scores */
+    bool traceback = true;
+    /** @brief alignment threads; std::thread::hardware_concurrency() if 0 */
+    unsigned workers = 0;
+    /** @brief sequence pairs per unit of work */
+    std::size_t batchSize = 64;
+    /** @brief batches in flight between reader and writer; 4 per worker if 0 */
+    std::size_t batches = 0;
+    /** @brief align identical pairs of a batch only once */
+    bool deduplicate = true;
+    /** @brief results of earlier batches and runs; none if null */
+    alignment_cache* cache = nullptr;
+};
+
+
+using pipeline_writer = std::function<void(const alignment_record&)>;
+
+
+struct pipeline_statistics {
+    std::uint64_t pairs = 0;
+    std::uint64_t batches = 0;
+    std::int64_t microseconds = 0;
+    std::uint64_t duplicates = 0;       //copied from the same batch
+    std::uint64_t cacheHits = 0;
+    std::uint64_t cacheMisses = 0;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief aligns each query against each reference record
+ *
+ *        streamed inputs are parsed ahead by a batch_prefetcher each,
+ *        a reader thread fills batches of pairs, a pool of workers aligns
+ *        them (one workspace per worker) and the calling thread passes
+ *        the results to 'write' in input order; the stages are connected
+ *        by lock-free bounded queues and recycle a fixed number of batches,
+ *        so reading stalls while the writer is behind
+ *
+ *        pairs are identified by a hash of their sequences, so pairs with
+ *        the same sequences as an earlier pair of the batch or as a cached
+ *        pair are not aligned again
+ *
+ *        the reference records are loaded up front (see sequence_records);
+ *        the first exception of any stage stops the pipeline and is rethrown
+ *
+ *****************************************************************************/
+pipeline_statistics
+align_against_reference(sequence_reader& queries, const sequence_records& reference,
+                        const pipeline_writer& write,
+                        const pipeline_options& = pipeline_options{});
+
+
+/*************************************************************************//**
+ *
+ * @brief aligns the i-th query with the i-th subject, see above;
+ *        throws io_format_error if the numbers of records differ
+ *
+ *****************************************************************************/
+pipeline_statistics
+align_pairs(sequence_reader& queries, sequence_reader& subjects,
+            const pipeline_writer& write,
+            const pipeline_options& = pipeline_options{});
+
+
+
+/*************************************************************************//**
+ *
+ * @brief aligns each pair of different records (i < j) of one input,
+ *        see above
+ *
+ *****************************************************************************/
+pipeline_statistics
+align_all_pairs(const sequence_records& records, const pipeline_writer& write,
+                const pipeline_options& = pipeline_options{});
+
+
+/*************************************************************************//**
+ *
+ * @brief aligns records 2i and 2i+1 of one input (e.g. a stream),
+ *        see above; throws io_format_error for an odd number of records
+ *
+ *****************************************************************************/
+pipeline_statistics
+align_interleaved(sequence_reader& records, const pipeline_writer& write,
+                  const pipeline_options& = pipeline_options{});
+
+
+
+/*************************************************************************//**
+ *
+ * @brief variants that format the records in the worker threads and
+ *        write the text of each batch to 'os' in input order;
+ *        the formatter's header is written first
+ *
+ *****************************************************************************/
+pipeline_statistics
+align_against_reference(sequence_reader& queries, const sequence_records& reference,
+                        const alignment_formatter&, std::ostream& os,
+                        const pipeline_options& = pipeline_options{});
+
+pipeline_statistics
+align_pairs(sequence_reader& queries, sequence_reader& subjects,
+            const alignment_formatter&, std::ostream& os,
+            const pipeline_options& = pipeline_options{});
+
+pipeline_statistics
+align_all_pairs(const sequence_records& records,
+                const alignment_formatter&, std::ostream& os,
+                const pipeline_options& = pipeline_options{});
+
+pipeline_statistics
+align_interleaved(sequence_reader& records,
+                  const alignment_formatter&, std::ostream& os,
+                  const pipeline_options& = pipeline_options{});
+
+
+
+/*************************************************************************//**
+ *
+ * @brief writes one tab-separated line per alignment: query name,
+ *        subject name, score, query begin and end, subject begin and end,
+ *        CIGAR ('*' if unknown)
+ *
+ *****************************************************************************/
+pipeline_writer tabular_writer(std::ostream&);
+
+
+} // namespace anyseq
+
+
+#endif
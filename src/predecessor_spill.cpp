@@ -0,0 +1,221 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "predecessor_spill.h"
+
+
+namespace anyseq {
+
+using std::string;
+
+
+//-------------------------------------------------------------------
+predecessor_spill::predecessor_spill(const string& filename,
+                                     tile_id numTiles,
+                                     std::size_t maxPending)
+:
+    fd_{-1},
+    end_{0},
+    offsets_(numTiles, -1),
+    sizes_(numTiles, 0),
+    maxPending_{maxPending > 0 ? maxPending : 1},
+    mutables_{}, changed_{}, pending_{},
+    writing_{false},
+    done_{false},
+    error_{},
+    writer_{}
+{
+    if(filename.empty()) {
+        const char* tmpdir = std::getenv("TMPDIR");
+        string name = string(tmpdir ? tmpdir : "/tmp") + "/anyseq_predc_XXXXXX";
+        fd_ = mkstemp(&name.front());
+        if(fd_ >= 0) unlink(name.c_str());
+    }
+    else {
+        fd_ = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    }
+
+    if(fd_ < 0) {
+        throw file_access_error{"can't open predecessor spill file", filename};
+    }
+
+    writer_ = std::thread{[this] { write_pending(); }};
+}
+
+
+
+//-------------------------------------------------------------------
+predecessor_spill::~predecessor_spill()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutables_);
+        done_ = true;
+    }
+    changed_.notify_all();
+    if(writer_.joinable()) writer_.join();
+    if(fd_ >= 0) close(fd_);
+}
+
+
+
+//-------------------------------------------------------------------
+void predecessor_spill::write(tile_id id, const char* data, size_type size)
+{
+    pending_tile tile {id, std::vector<char>(data, data + size)};
+
+    std::unique_lock<std::mutex> lock(mutables_);
+    changed_.wait(lock, [this] { return pending_.size() < maxPending_; });
+
+    pending_.push_back(std::move(tile));
+    changed_.notify_all();
+}
+
+
+
+//-------------------------------------------------------------------
+void predecessor_spill::flush()
+{
+    std::unique_lock<std::mutex> lock(mutables_);
+    changed_.wait(lock, [this] { return pending_.empty() && !writing_; });
+
+    if(!error_.empty()) {
+        throw file_write_error{error_};
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+void predecessor_spill::read(tile_id id, char* data, size_type size)
+{
+    flush();
+
+    if(id < 0 || id >= tile_id(offsets_.size()) || offsets_[id] < 0) {
+        throw file_read_error{"predecessor tile " + std::to_string(id) + " was never written"};
+    }
+    if(sizes_[id] < size) size = sizes_[id];
+
+    for(size_type done = 0; done < size; ) {
+        auto n = pread(fd_, data + done, size - done, offsets_[id] + done);
+        if(n <= 0) {
+            throw file_read_error{"can't read predecessor tile " + std::to_string(id)};
+        }
+        done += n;
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+void predecessor_spill::prefetch(tile_id id)
+{
+    std::lock_guard<std::mutex> lock(mutables_);
+
+    if(id < 0 || id >= tile_id(offsets_.size()) || offsets_[id] < 0) return;
+
+    posix_fadvise(fd_, offsets_[id], sizes_[id], POSIX_FADV_WILLNEED);
+}
+
+
+
+//-------------------------------------------------------------------
+void predecessor_spill::write_pending()
+{
+    std::unique_lock<std::mutex> lock(mutables_);
+
+    while(true) {
+        changed_.wait(lock, [this] { return done_ || !pending_.empty(); });
+        if(pending_.empty()) return;
+
+        pending_tile tile = std::move(pending_.front());
+        pending_.pop_front();
+        writing_ = true;
+        //space for the next tile
+        changed_.notify_all();
+
+        const size_type offset = end_;
+        const size_type size = tile.data.size();
+        end_ += size;
+
+        lock.unlock();
+        bool ok = true;
+        for(size_type done = 0; ok && done < size; ) {
+            auto n = pwrite(fd_, tile.data.data() + done, size - done, offset + done);
+            if(n <= 0) ok = false; else done += n;
+        }
+        lock.lock();
+
+        if(ok) {
+            offsets_[tile.id] = offset;
+            sizes_[tile.id] = size;
+        }
+        else if(error_.empty()) {
+            error_ = "can't write predecessor tile " + std::to_string(tile.id);
+        }
+        writing_ = false;
+        changed_.notify_all();
+    }
+}
+
+
+} // namespace anyseq
+
+
+
+//-------------------------------------------------------------------
+// C interface
+//-------------------------------------------------------------------
+namespace {
+
+[[noreturn]] void spill_failure(const std::exception& e)
+{
+    std::cerr << "predecessor spill: " << e.what() << std::endl;
+    std::abort();
+}
+
+} // namespace
+
+
+void* anyseq_spill_create(const char* filename, std::int32_t numTiles)
+{
+    try {
+        return new anyseq::predecessor_spill{filename ? filename : "", numTiles};
+    }
+    catch(std::exception& e) {
+        spill_failure(e);
+    }
+}
+
+void anyseq_spill_write(void* spill, std::int32_t tile, const char* data, std::int64_t size)
+{
+    try {
+        static_cast<anyseq::predecessor_spill*>(spill)->write(tile, data, size);
+    }
+    catch(std::exception& e) {
+        spill_failure(e);
+    }
+}
+
+void anyseq_spill_read(void* spill, std::int32_t tile, char* data, std::int64_t size)
+{
+    try {
+        static_cast<anyseq::predecessor_spill*>(spill)->read(tile, data, size);
+    }
+    catch(std::exception& e) {
+        spill_failure(e);
+    }
+}
+
+void anyseq_spill_prefetch(void* spill, std::int32_t tile)
+{
+    static_cast<anyseq::predecessor_spill*>(spill)->prefetch(tile);
+}
+
+void anyseq_spill_release(void* spill)
+{
+    delete static_cast<anyseq::predecessor_spill*>(spill);
+}
@@ -0,0 +1,103 @@
+#ifndef ANYSEQ_PREDECESSOR_SPILL_H_
+#define ANYSEQ_PREDECESSOR_SPILL_H_
+
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "io_error.h"
+
+
+namespace anyseq {
+
+
+/*************************************************************************//**
+ *
+ * @brief append-only file of predecessor matrix tiles
+ *
+ *        tiles are appended in the order in which they are completed
+ *        (wavefront order); writing happens on a background thread
+ *        and at most 'max_pending' tiles are buffered in memory
+ *
+ *****************************************************************************/
+class predecessor_spill
+{
+public:
+    using tile_id = std::int32_t;
+    using size_type = std::int64_t;
+
+    /** @brief opens 'filename' for writing; uses an unlinked temporary
+     *         file if the filename is empty */
+    explicit
+    predecessor_spill(const std::string& filename, tile_id numTiles,
+                      std::size_t maxPending = 16);
+
+    predecessor_spill(const predecessor_spill&) = delete;
+    predecessor_spill& operator = (const predecessor_spill&) = delete;
+
+    ~predecessor_spill();
+
+    /** @brief queues a copy of a completed tile for writing;
+     *         blocks while too many tiles are pending */
+    void write(tile_id, const char* data, size_type size);
+
+    /** @brief reads a tile back; waits for pending writes first */
+    void read(tile_id, char* data, size_type size);
+
+    /** @brief hints that a tile will be read soon */
+    void prefetch(tile_id);
+
+    /** @brief waits until all queued tiles are on disk */
+    void flush();
+
+private:
+    struct pending_tile {
+        tile_id id;
+        std::vector<char> data;
+    };
+
+    void write_pending();
+
+    int fd_;
+    size_type end_;
+    std::vector<size_type> offsets_;
+    std::vector<size_type> sizes_;
+    std::size_t maxPending_;
+
+    std::mutex mutables_;
+    std::condition_variable changed_;
+    std::deque<pending_tile> pending_;
+    bool writing_;
+    bool done_;
+    std::string error_;
+    std::thread writer_;
+};
+
+
+} // namespace anyseq
+
+
+
+extern "C" {
+
+// interface for "predecessors.impala"; I/O errors are fatal
+
+void* anyseq_spill_create(const char* filename, std::int32_t numTiles);
+
+void anyseq_spill_write(void* spill, std::int32_t tile, const char* data, std::int64_t size);
+
+void anyseq_spill_read(void* spill, std::int32_t tile, char* data, std::int64_t size);
+
+void anyseq_spill_prefetch(void* spill, std::int32_t tile);
+
+void anyseq_spill_release(void* spill);
+
+}
+
+
+#endif
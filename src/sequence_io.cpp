@@ -1,4 +1,18 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <numeric>
 #include <sstream>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "io_error.h"
 #include "sequence_io.h"
@@ -9,6 +23,43 @@ namespace anyseq {
 using std::string;
 
 
+//-------------------------------------------------------------------
+void sequence_reader::batch::clear() noexcept
+{
+    indices_.clear();
+    bytes_.clear();
+    offsets_.resize(1);
+}
+
+
+
+//-------------------------------------------------------------------
+void sequence_reader::batch::push_back(const sequence& seq)
+{
+    indices_.push_back(seq.index);
+    for(const auto* field : {&seq.header, &seq.data, &seq.qualities}) {
+        bytes_.insert(bytes_.end(), field->begin(), field->end());
+        offsets_.push_back(bytes_.size());
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+void sequence_reader::batch::push_back(const batch& other, std::size_t i)
+{
+    indices_.push_back(other.indices_[i]);
+    const auto begin = other.offsets_[3*i];
+    const auto size = bytes_.size();
+    bytes_.insert(bytes_.end(), other.bytes_.begin() + std::ptrdiff_t(begin),
+                  other.bytes_.begin() + std::ptrdiff_t(other.offsets_[3*i + 3]));
+    for(int field = 1; field <= 3; ++field) {
+        offsets_.push_back(size + (other.offsets_[3*i + field] - begin));
+    }
+}
+
+
+
 //-------------------------------------------------------------------
 sequence_reader::sequence
 sequence_reader::next()
@@ -25,6 +76,32 @@ sequence_reader::next()
 
 
 
+//-------------------------------------------------------------------
+std::size_t sequence_reader::next_batch(batch& b, std::size_t n)
+{
+    b.clear();
+    if(n < 1 || !has_next()) return 0;
+
+    std::lock_guard<std::mutex> lock(mutables_);
+
+    while(b.size() < n && has_next()) {
+        scratch_.header.clear();
+        scratch_.data.clear();
+        scratch_.qualities.clear();
+        ++index_;
+        scratch_.index = index_;
+        read_next(scratch_);
+
+        //the end of a file can leave an empty sequence
+        if(!scratch_.header.empty() || !scratch_.data.empty()) {
+            b.push_back(scratch_);
+        }
+    }
+    return b.size();
+}
+
+
+
 //-------------------------------------------------------------------
 void sequence_reader::skip(index_type skip)
 {
@@ -42,18 +119,99 @@ void sequence_reader::skip(index_type skip)
 
 
 
+//-------------------------------------------------------------------
+batch_prefetcher::batch_prefetcher(sequence_reader& reader,
+                                   std::size_t batchSize, std::size_t batches):
+    reader_(reader),
+    batchSize_{std::max(batchSize, std::size_t(1))},
+    free_{std::max(batches, std::size_t(1))},
+    full_{std::max(batches, std::size_t(1))},
+    stop_{false},
+    error_{},
+    producer_{}
+{
+    //both queues can take all batches, so pushes never wait
+    for(std::size_t i = 0; i < std::max(batches, std::size_t(1)); ++i) {
+        free_.push(std::unique_ptr<batch>{new batch{}});
+    }
+    producer_ = std::thread{[this] { read(); }};
+}
+
+
+//-------------------------------------------------------------------
+batch_prefetcher::~batch_prefetcher()
+{
+    stop_.store(true);
+    free_.close();
+    if(producer_.joinable()) producer_.join();
+}
+
+
+//-------------------------------------------------------------------
+void batch_prefetcher::read()
+{
+    try {
+        std::unique_ptr<batch> b;
+        while(!stop_.load() && free_.pop(b)) {
+            if(reader_.next_batch(*b, batchSize_) < 1) break;
+            full_.push(std::move(b));
+        }
+    }
+    catch(...) {
+        //published by close()
+        error_ = std::current_exception();
+    }
+    full_.close();
+}
+
+
+//-------------------------------------------------------------------
+std::size_t batch_prefetcher::next_batch(batch& b)
+{
+    std::unique_ptr<batch> next;
+    if(!full_.pop(next)) {
+        if(error_) std::rethrow_exception(error_);
+        b.clear();
+        return 0;
+    }
+    std::swap(b, *next);
+    free_.push(std::move(next));
+    return b.size();
+}
+
+
+
 //-------------------------------------------------------------------
 fasta_reader::fasta_reader(string filename):
     sequence_reader{},
-    file_{},
+    buffer_{open_sequence_file(filename)},
+    file_{buffer_.get()},
+    line_{},
     linebuffer_{}
 {
-    file_.open(filename.c_str());
-
-    if(file_.rdstate() & std::ifstream::failbit) {
+    if(!buffer_) {
         invalidate();
         throw file_access_error{"can't open file " + filename};
     }
+    //decompression errors are thrown from the stream buffer
+    file_.exceptions(std::ios::badbit);
+}
+
+
+
+//-------------------------------------------------------------------
+fasta_reader::fasta_reader(std::unique_ptr<std::streambuf> buffer):
+    sequence_reader{},
+    buffer_{std::move(buffer)},
+    file_{buffer_.get()},
+    line_{},
+    linebuffer_{}
+{
+    if(!buffer_) {
+        invalidate();
+        throw file_access_error{"no input buffer"};
+    }
+    file_.exceptions(std::ios::badbit);
 }
 
 
@@ -65,37 +223,34 @@ void fasta_reader::read_next(sequence& seq)
         invalidate();
         return;
     }
-    string line;
-
+    //line buffers keep their capacity between calls
+    using std::swap;
     if(linebuffer_.empty()) {
-        getline(file_, line);
+        getline(file_, line_);
     }
     else {
-        line.clear();
-        using std::swap;
-        swap(line, linebuffer_);
+        swap(line_, linebuffer_);
+        linebuffer_.clear();
     }
 
-    if(line[0] != '>') {
+    if(line_[0] != '>') {
         throw io_format_error{"malformed fasta file - expected header char > not found"};
         invalidate();
         return;
     }
-    seq.header = line.substr(1);
-    
-    std::ostringstream seqss;
+    seq.header.assign(line_, 1, string::npos);
+    seq.data.clear();
 
     while(file_.good()) {
-        getline(file_, line);
-        if(line[0] == '>') {
-            linebuffer_ = line;
+        getline(file_, line_);
+        if(line_[0] == '>') {
+            swap(line_, linebuffer_);
             break;
         }
         else {
-            seqss << line;
+            seq.data += line_;
         }
     }
-    seq.data = seqss.str();
 
     if(seq.data.empty()) {
         throw io_format_error{"malformed fasta file - zero-length sequence: " + seq.header};
@@ -113,133 +268,1404 @@ void fasta_reader::read_next(sequence& seq)
 
 
 //-------------------------------------------------------------------
-fastq_reader::fastq_reader(string filename):
-    sequence_reader{},
-    file_{}
+namespace {
+
+/// @brief part of a FASTA file that starts at a line start
+struct line_chunk {
+    std::size_t begin = 0;
+    std::size_t end = 0;
+};
+
+
+//-------------------------------------------------------------------
+/// @brief chunk of mapped_fasta
+struct fasta_chunk : public line_chunk {
+    struct header {
+        std::size_t begin;
+        std::size_t end;
+        std::size_t keptBefore;     //sequence bytes of the chunk before it
+        std::size_t lines;          //non-empty sequence lines in the chunk
+        std::size_t first;          //start of the first one
+    };
+    std::size_t kept = 0;           //sequence bytes in the chunk
+    std::size_t out = 0;            //offset of the chunk's sequence bytes
+    std::size_t leadLines = 0;      //sequence lines before the first header
+    std::size_t leadFirst = 0;
+    std::size_t firstRecord = 0;    //record of the first header
+    std::vector<header> headers;
+};
+
+
+//-------------------------------------------------------------------
+/// @brief first line start at or after 'pos'
+std::size_t next_line_start(const char* text, std::size_t size, std::size_t pos)
 {
-    file_.open(filename.c_str());
+    if(pos == 0 || pos >= size) return std::min(pos, size);
+    if(text[pos-1] == '\n') return pos;
 
-    if(file_.rdstate() & std::ifstream::failbit) {
-        invalidate();
-        throw file_access_error{"can't open file " + filename};
+    auto nl = static_cast<const char*>(std::memchr(text + pos, '\n', size - pos));
+    return nl ? std::size_t(nl - text) + 1 : size;
+}
+
+
+//-------------------------------------------------------------------
+/// @brief calls 'f(begin,end,next)' for each line in [begin,end);
+///        'end' excludes the line end ("\n" or "\r\n"), 'next' doesn't
+template<class Function>
+void for_each_line(const char* text, std::size_t begin, std::size_t end,
+                   Function&& f)
+{
+    while(begin < end) {
+        auto nl = static_cast<const char*>(
+                      std::memchr(text + begin, '\n', end - begin));
+
+        auto stop = nl ? std::size_t(nl - text) : end;
+        auto next = nl ? stop + 1 : end;
+        if(stop > begin && text[stop-1] == '\r') --stop;
+
+        f(begin, stop, next);
+        begin = next;
+    }
+}
+
+
+//-------------------------------------------------------------------
+/// @brief splits 'text' into about equally sized chunks of whole lines;
+///        at least 1 MiB per chunk
+template<class Chunk>
+std::vector<Chunk>
+line_chunks(const char* text, std::size_t size, unsigned threads)
+{
+    const std::size_t minChunk = std::size_t(1) << 20;
+    const auto numChunks = std::min(std::size_t(std::max(threads, 1u)),
+                                    size / minChunk + 1);
+
+    std::vector<Chunk> chunks(numChunks);
+    for(std::size_t i = 0; i < numChunks; ++i) {
+        chunks[i].begin = next_line_start(text, size, size / numChunks * i);
+        chunks[i].end   = next_line_start(text, size, size / numChunks * (i+1));
     }
+    chunks.back().end = size;
+    return chunks;
 }
 
 
+//-------------------------------------------------------------------
+template<class Chunk, class Function>
+void for_each_chunk(std::vector<Chunk>& chunks, Function&& f)
+{
+    std::vector<std::thread> threads;
+    threads.reserve(chunks.size());
+    for(auto& c : chunks) {
+        threads.emplace_back([&f,&c] { f(c); });
+    }
+    for(auto& t : threads) t.join();
+}
 
 //-------------------------------------------------------------------
-void fastq_reader::read_next(sequence& seq)
+/// @brief maps a whole file read-only; returns nullptr for empty files
+const char* map_file(const string& filename, std::size_t& size,
+                     int advice = MADV_SEQUENTIAL)
 {
-    if(!file_.good()) {
-        invalidate();
-        return;
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0) {
+        throw file_access_error{"can't open file " + filename};
     }
 
-    string line;
-    getline(file_, line);
-    if(line.empty()) {
-        invalidate();
-        return;
+    struct stat info;
+    if(fstat(fd, &info) != 0) {
+        close(fd);
+        throw file_access_error{"can't open file " + filename};
     }
-    if(line[0] != '@') {
-        if(line[0] != '\r') {
-            throw io_format_error{"malformed fastq file - sequence header: "  + line};
+    size = std::size_t(info.st_size);
+
+    void* map = nullptr;
+    if(size > 0) {
+        map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(map == MAP_FAILED) {
+            close(fd);
+            throw file_read_error{"can't map file " + filename};
         }
-        invalidate();
-        return;
+        madvise(map, size, advice);
     }
-    seq.header = line.substr(1);
-    getline(file_, seq.data);
+    close(fd);
+    return static_cast<const char*>(map);
+}
+
+
+//-------------------------------------------------------------------
+void unmap_file(const char* data, std::size_t size)
+{
+    if(data) munmap(const_cast<char*>(data), size);
+}
+
+} // namespace
+
+
+
+//-------------------------------------------------------------------
+mapped_fasta::mapped_fasta(const string& filename, unsigned threads):
+    file_{nullptr},
+    fileSize_{0},
+    data_{},
+    records_{}
+{
+    //each thread reads its chunk front to back
+    file_ = map_file(filename, fileSize_);
+
+    if(threads < 1) threads = std::thread::hardware_concurrency();
 
-    getline(file_, line);
-    if(line.empty() || line[0] != '+') {
-        if(line[0] != '\r') {
-            throw io_format_error{"malformed fastq file - quality header: "  + line};
+    try {
+        join_lines(std::max(threads, 1u));
+    }
+    catch(...) {
+        unmap_file(file_, fileSize_);
+        throw;
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+mapped_fasta::~mapped_fasta()
+{
+    unmap_file(file_, fileSize_);
+}
+
+
+
+//-------------------------------------------------------------------
+void mapped_fasta::join_lines(unsigned threads)
+{
+    //chunk borders at line starts keep header lines in one chunk
+    auto chunks = line_chunks<fasta_chunk>(file_, fileSize_, threads);
+
+    const char* text = file_;
+
+    for_each_chunk(chunks, [text] (fasta_chunk& c) {
+        for_each_line(text, c.begin, c.end, [&] (std::size_t b, std::size_t e, std::size_t) {
+            if(b < e && text[b] == '>') {
+                c.headers.push_back({b + 1, e, c.kept, 0, 0});
+            }
+            else {
+                if(b < e) {
+                    auto& lines = c.headers.empty() ? c.leadLines : c.headers.back().lines;
+                    auto& first = c.headers.empty() ? c.leadFirst : c.headers.back().first;
+                    if(lines++ == 0) first = b;
+                }
+                c.kept += e - b;
+            }
+        });
+    });
+
+    //offsets as if all sequence lines were joined
+    std::vector<std::size_t> offsets;
+    std::vector<std::size_t> lines;
+    std::vector<std::size_t> firsts;
+    std::size_t total = 0;
+    for(auto& c : chunks) {
+        if(records_.empty() && c.kept > 0 &&
+           (c.headers.empty() || c.headers.front().keptBefore > 0))
+        {
+            throw io_format_error{"malformed fasta file - expected header char > not found"};
         }
-        invalidate();
-        return;
+        if(!records_.empty() && c.leadLines > 0) {
+            if(lines.back() == 0) firsts.back() = c.leadFirst;
+            lines.back() += c.leadLines;
+        }
+        c.out = total;
+        c.firstRecord = records_.size();
+        for(const auto& h : c.headers) {
+            records_.push_back(record{file_ + h.begin, h.end - h.begin, nullptr, 0});
+            offsets.push_back(c.out + h.keptBefore);
+            lines.push_back(h.lines);
+            firsts.push_back(h.first);
+        }
+        total += c.kept;
     }
-    getline(file_, seq.qualities);
+    offsets.push_back(total);
+
+    //sequences on one line are used in place, others are joined
+    std::vector<std::size_t> joined(records_.size(), 0);
+    std::size_t joinedTotal = 0;
+    for(std::size_t i = 0; i < records_.size(); ++i) {
+        auto& r = records_[i];
+        r.size = offsets[i+1] - offsets[i];
+        if(r.size == 0) {
+            throw io_format_error{"malformed fasta file - zero-length sequence: "
+                                  + r.header_string()};
+        }
+        if(lines[i] == 1) {
+            r.data = text + firsts[i];
+        } else {
+            joined[i] = joinedTotal;
+            joinedTotal += r.size;
+        }
+    }
+    if(joinedTotal < 1) return;
+
+    data_.reset(new char[joinedTotal]);
+    char* data = data_.get();
+
+    for(std::size_t i = 0; i < records_.size(); ++i) {
+        if(lines[i] != 1) records_[i].data = data + joined[i];
+    }
+
+    for_each_chunk(chunks, [&] (fasta_chunk& c) {
+        //lines before the first header belong to the previous record
+        auto rec = c.firstRecord;
+        bool copy = rec > 0 && lines[rec-1] != 1;
+        auto out = copy ? data + joined[rec-1] + (c.out - offsets[rec-1]) : data;
+
+        for_each_line(text, c.begin, c.end, [&] (std::size_t b, std::size_t e, std::size_t) {
+            if(b < e && text[b] == '>') {
+                copy = lines[rec] != 1;
+                out = data + joined[rec];
+                ++rec;
+            }
+            else if(copy) {
+                std::memcpy(out, text + b, e - b);
+                out += e - b;
+            }
+        });
+    });
 }
 
 
 
+//-------------------------------------------------------------------
+namespace {
+
+/// @brief consecutive sequence lines; empty lines are only allowed at
+///        the end of a record since they would break the offset formula
+struct line_run {
+    std::uint64_t bases = 0;
+    std::uint64_t lines = 0;            //non-empty lines
+    std::uint64_t firstBases = 0;
+    std::uint64_t firstWidth = 0;
+    std::uint64_t lastBases = 0;
+    std::uint64_t lastWidth = 0;
+    std::uint64_t trailingEmpty = 0;
+    bool uniform = true;                //all lines but the last like the first
+};
+
 
 //-------------------------------------------------------------------
-sequence_header_reader::sequence_header_reader(string filename):
-    file_{}
+line_run single_line(std::uint64_t bases, std::uint64_t width)
 {
-    file_.open(filename.c_str());
+    line_run r;
+    if(bases == 0) {
+        r.trailingEmpty = 1;
+    } else {
+        r.bases = bases;
+        r.lines = 1;
+        r.firstBases = r.lastBases = bases;
+        r.firstWidth = r.lastWidth = width;
+    }
+    return r;
+}
 
-    if(file_.rdstate() & std::ifstream::failbit) {
-        invalidate();
-        throw file_access_error{"can't open file " + filename};
+
+//-------------------------------------------------------------------
+void append(line_run& a, const line_run& b)
+{
+    if(b.lines == 0) {
+        a.trailingEmpty += b.trailingEmpty;
+        return;
+    }
+    if(a.lines == 0) {
+        const bool leadingEmpty = a.trailingEmpty > 0;
+        a = b;
+        if(leadingEmpty) a.uniform = false;
+        return;
     }
+    a.uniform = a.uniform && b.uniform && a.trailingEmpty == 0 &&
+                a.lastBases == a.firstBases && a.lastWidth == a.firstWidth &&
+                (b.lines == 1 ||
+                 (b.firstBases == a.firstBases && b.firstWidth == a.firstWidth));
+
+    a.bases += b.bases;
+    a.lines += b.lines;
+    a.lastBases = b.lastBases;
+    a.lastWidth = b.lastWidth;
+    a.trailingEmpty = b.trailingEmpty;
 }
 
 
+//-------------------------------------------------------------------
+/// @brief chunk of fasta_index::build
+struct fai_chunk : public line_chunk {
+    struct record {
+        string name;
+        std::uint64_t offset;
+        line_run run;
+    };
+    line_run leading;                   //lines before the first header
+    std::vector<record> records;
+};
+
+} // namespace
+
+
 
 //-------------------------------------------------------------------
-void sequence_header_reader::read_next(sequence& seq)
+fasta_index fasta_index::build(const string& fastaFile, unsigned threads)
 {
+    std::size_t size = 0;
+    const char* text = map_file(fastaFile, size);
 
-    bool headerFound = false;
-    do {
-        if(!file_.good()) {
-            invalidate();
-            return;
+    if(threads < 1) threads = std::thread::hardware_concurrency();
+    auto chunks = line_chunks<fai_chunk>(text, size, threads);
+
+    for_each_chunk(chunks, [text] (fai_chunk& c) {
+        for_each_line(text, c.begin, c.end,
+            [&] (std::size_t b, std::size_t e, std::size_t next) {
+                if(b < e && text[b] == '>') {
+                    auto n = b + 1;
+                    while(n < e && !std::isspace(static_cast<unsigned char>(text[n]))) ++n;
+                    c.records.push_back({string(text + b + 1, text + n), next, line_run{}});
+                }
+                else {
+                    append(c.records.empty() ? c.leading : c.records.back().run,
+                           single_line(e - b, next - b));
+                }
+            });
+    });
+    unmap_file(text, size);
+
+    //records may continue in later chunks
+    std::vector<fai_chunk::record> records;
+    for(auto& c : chunks) {
+        if(records.empty()) {
+            if(c.leading.lines > 0) {
+                throw io_format_error{"malformed fasta file - expected header char > not found"};
+            }
+        } else {
+            append(records.back().run, c.leading);
+        }
+        std::move(c.records.begin(), c.records.end(), std::back_inserter(records));
+    }
+
+    fasta_index index;
+    for(auto& r : records) {
+        if(r.run.lines == 0) {
+            throw io_format_error{"malformed fasta file - zero-length sequence: " + r.name};
         }
+        if(!r.run.uniform || r.run.lastBases > r.run.firstBases) {
+            throw io_format_error{"malformed fasta file - different line lengths in sequence: " + r.name};
+        }
+        index.push_back(entry{std::move(r.name), r.run.bases, r.offset,
+                              r.run.firstBases, r.run.firstWidth});
+    }
+    return index;
+}
 
-        string line;
-        getline(file_, line);
 
-        headerFound = line[0] == '>' || line[0] == '@';
-        if(headerFound) {
-            seq.header = line.substr(1);
+
+//-------------------------------------------------------------------
+fasta_index fasta_index::load(const string& faiFile)
+{
+    std::ifstream is {faiFile};
+    if(!is.good()) {
+        throw file_access_error{"can't open file " + faiFile};
+    }
+
+    fasta_index index;
+    string line;
+    while(getline(is, line)) {
+        if(line.empty()) continue;
+
+        std::istringstream fields {line};
+        entry e;
+        getline(fields, e.name, '\t');
+        fields >> e.length >> e.offset >> e.lineBases >> e.lineWidth;
+
+        if(!fields || e.lineBases < 1 || e.lineWidth < e.lineBases) {
+            throw io_format_error{"malformed fasta index - line: " + line};
         }
-    } while(!headerFound);
+        index.push_back(std::move(e));
+    }
+    return index;
 }
 
 
 
 //-------------------------------------------------------------------
-std::unique_ptr<sequence_reader>
-make_sequence_reader(const string& filename)
+void fasta_index::save(const string& faiFile) const
 {
-    auto n = filename.size();
-    if(filename.find(".fq")    == (n-3) ||
-       filename.find(".fnq")   == (n-4) ||
-       filename.find(".fastq") == (n-6) )
-    {
-        return std::unique_ptr<sequence_reader>{new fastq_reader{filename}};
+    std::ofstream os {faiFile};
+    if(!os.good()) {
+        throw file_write_error{"can't write file " + faiFile};
     }
-    else if(filename.find(".fa")    == (n-3) ||
-            filename.find(".fna")   == (n-4) ||
-            filename.find(".fasta") == (n-6) )
-    {
-        return std::unique_ptr<sequence_reader>{new fasta_reader{filename}};
+    for(const auto& e : entries_) {
+        os << e.name << '\t' << e.length << '\t' << e.offset << '\t'
+           << e.lineBases << '\t' << e.lineWidth << '\n';
     }
+}
 
-    //try to determine file type content
-    std::ifstream is {filename};
-    if(is.good()) {
-        string line;
-        getline(is,line);
-        if(!line.empty()) {
-            if(line[0] == '>') {
-                return std::unique_ptr<sequence_reader>{new fasta_reader{filename}};
+
+
+//-------------------------------------------------------------------
+void fasta_index::push_back(entry e)
+{
+    //first record wins for duplicate names, like in samtools
+    byName_.emplace(e.name, entries_.size());
+    entries_.push_back(std::move(e));
+}
+
+
+
+//-------------------------------------------------------------------
+std::size_t fasta_index::find(const string& name) const
+{
+    auto it = byName_.find(name);
+    return it != byName_.end() ? it->second : entries_.size();
+}
+
+
+
+
+//-------------------------------------------------------------------
+indexed_fasta::indexed_fasta(const string& filename, unsigned threads):
+    fd_{open(filename.c_str(), O_RDONLY)},
+    index_{}
+{
+    if(fd_ < 0) {
+        throw file_access_error{"can't open file " + filename};
+    }
+
+    const auto faiFile = filename + ".fai";
+    struct stat fasta;
+    struct stat fai;
+    try {
+        if(fstat(fd_, &fasta) == 0 && stat(faiFile.c_str(), &fai) == 0 &&
+           fai.st_mtime >= fasta.st_mtime)
+        {
+            index_ = fasta_index::load(faiFile);
+        }
+        else {
+            index_ = fasta_index::build(filename, threads);
+            try {
+                index_.save(faiFile);
             }
-            else if(line[0] == '@') {
-                return std::unique_ptr<sequence_reader>{new fastq_reader{filename}};
+            catch(file_io_error&) {
+                //read-only location: rebuild next time
             }
         }
-        throw file_read_error{"file format not recognized"};
     }
+    catch(...) {
+        close(fd_);
+        throw;
+    }
+}
 
-    throw file_access_error{"file not accessible"};
-    return nullptr;
+
+
+//-------------------------------------------------------------------
+indexed_fasta::~indexed_fasta()
+{
+    close(fd_);
+}
+
+
+
+//-------------------------------------------------------------------
+string indexed_fasta::fetch(std::size_t record) const
+{
+    if(record >= index_.size()) {
+        throw std::out_of_range{"fasta record number out of range"};
+    }
+    return fetch(record, 0, index_[record].length);
 }
 
 
+
+//-------------------------------------------------------------------
+string indexed_fasta::fetch(std::size_t record,
+                            std::uint64_t begin, std::uint64_t end) const
+{
+    if(record >= index_.size()) {
+        throw std::out_of_range{"fasta record number out of range"};
+    }
+    const auto& e = index_[record];
+
+    end = std::min(end, e.length);
+    if(begin >= end) return string{};
+
+    //file positions of the first and one past the last base
+    const auto first = e.offset + begin / e.lineBases * e.lineWidth + begin % e.lineBases;
+    const auto last  = e.offset + (end-1) / e.lineBases * e.lineWidth + (end-1) % e.lineBases + 1;
+
+    string seq;
+    seq.resize(last - first);
+
+    std::size_t done = 0;
+    while(done < seq.size()) {
+        auto n = pread(fd_, &seq[done], seq.size() - done, off_t(first + done));
+        if(n <= 0) {
+            throw file_read_error{"can't read fasta record " + e.name};
+        }
+        done += std::size_t(n);
+    }
+
+    seq.erase(std::remove_if(seq.begin(), seq.end(),
+                             [](char c) { return c == '\n' || c == '\r'; }),
+              seq.end());
+    return seq;
+}
+
+
+
+//-------------------------------------------------------------------
+string indexed_fasta::fetch(const string& name,
+                            std::uint64_t begin, std::uint64_t end) const
+{
+    const auto record = index_.find(name);
+    if(record >= index_.size()) {
+        throw std::out_of_range{"unknown fasta record " + name};
+    }
+    return fetch(record, begin, end);
+}
+
+
+
+//-------------------------------------------------------------------
+namespace {
+
+/// @brief region "name" or "name:begin-end" (1-based, inclusive)
+///        of an indexed_fasta or packed_sequences
+template<class Source>
+string fetch_source_region(const Source& source, const string& region)
+{
+    //names may contain ':' themselves
+    if(source.find(region) < source.size()) {
+        return source.fetch(region, 0, std::numeric_limits<std::uint64_t>::max());
+    }
+
+    const auto colon = region.rfind(':');
+    const auto dash  = region.find('-', colon);
+    if(colon == string::npos || dash == string::npos) {
+        throw std::out_of_range{"unknown sequence record " + region};
+    }
+
+    std::uint64_t begin = 0;
+    std::uint64_t end = 0;
+    try {
+        begin = std::stoull(region.substr(colon + 1, dash - colon - 1));
+        end   = std::stoull(region.substr(dash + 1));
+    }
+    catch(std::exception&) {
+        throw std::out_of_range{"malformed region " + region};
+    }
+    if(begin < 1 || end < begin) {
+        throw std::out_of_range{"malformed region " + region};
+    }
+    return source.fetch(region.substr(0, colon), begin - 1, end);
+}
+
+} // namespace
+
+
+
+//-------------------------------------------------------------------
+string indexed_fasta::fetch_region(const string& region) const
+{
+    return fetch_source_region(*this, region);
+}
+
+
+
+//-------------------------------------------------------------------
+/// @brief layout of a packed sequence file (host byte order):
+///        header | bases | records | intervals | by name | by length | headers
+///        all sections but the bases and headers start 8-byte aligned
+struct packed_sequences::file_header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrder;
+    std::uint64_t records;
+    std::uint64_t totalBases;
+    std::uint64_t basesBytes;
+    std::uint64_t intervals;
+    std::uint64_t headersBytes;
+    std::uint64_t recordsOffset;
+    std::uint64_t intervalsOffset;
+    std::uint64_t byNameOffset;
+    std::uint64_t byLengthOffset;
+    std::uint64_t headersOffset;
+};
+
+struct packed_sequences::file_record {
+    std::uint64_t length;
+    std::uint64_t basesOffset;      //in the bases section
+    std::uint64_t headerOffset;     //in the headers section
+    std::uint64_t headerSize;
+    std::uint64_t firstN;           //N intervals, sorted and disjoint
+    std::uint64_t numN;
+    std::uint64_t firstMask;        //lower case intervals, sorted and disjoint
+    std::uint64_t numMask;
+};
+
+struct packed_sequences::file_interval {
+    std::uint64_t begin;
+    std::uint64_t end;
+};
+
+
+
+//-------------------------------------------------------------------
+namespace {
+
+constexpr char packed_magic[8] = {'A','N','Y','S','E','Q','2','B'};
+constexpr std::uint32_t packed_version = 1;
+constexpr std::uint32_t packed_byte_order = 0x01020304;
+
+
+//-------------------------------------------------------------------
+/// @brief 2-bit code of ACGT in any case; 4 for all other characters
+inline unsigned base_code(char c) noexcept
+{
+    switch(c) {
+        case 'A': case 'a': return 0;
+        case 'C': case 'c': return 1;
+        case 'G': case 'g': return 2;
+        case 'T': case 't': return 3;
+        default:            return 4;
+    }
+}
+
+
+//-------------------------------------------------------------------
+/// @brief the 4 bases of each packed byte; the first base is in the low bits
+const char* unpacked_bytes() noexcept
+{
+    static const auto table = [] {
+        std::vector<char> t(256 * 4);
+        for(unsigned b = 0; b < 256; ++b) {
+            for(unsigned k = 0; k < 4; ++k) {
+                t[4*b + k] = "ACGT"[(b >> (2*k)) & 3];
+            }
+        }
+        return t;
+    }();
+    return table.data();
+}
+
+
+//-------------------------------------------------------------------
+/// @brief extends the last interval or starts a new one at 'pos'
+template<class Intervals>
+void add_position(Intervals& intervals, std::uint64_t pos)
+{
+    if(!intervals.empty() && intervals.back().end == pos) {
+        ++intervals.back().end;
+    } else {
+        intervals.push_back({pos, pos + 1});
+    }
+}
+
+
+//-------------------------------------------------------------------
+/// @brief calls f(from,to) for the parts of sorted, disjoint intervals
+///        that overlap [begin,end)
+template<class Interval, class Function>
+void for_each_overlap(const Interval* first, std::uint64_t num,
+                      std::uint64_t begin, std::uint64_t end, Function&& f)
+{
+    auto i = std::upper_bound(first, first + num, begin,
+        [](std::uint64_t pos, const Interval& iv) { return pos < iv.end; });
+
+    for(; i != first + num && i->begin < end; ++i) {
+        f(std::max(i->begin, begin), std::min(i->end, end));
+    }
+}
+
+
+//-------------------------------------------------------------------
+/// @brief length of the header up to the first white space
+std::size_t name_size(const char* header, std::size_t size) noexcept
+{
+    std::size_t n = 0;
+    while(n < size && header[n] != ' ' && header[n] != '\t') ++n;
+    return n;
+}
+
+
+//-------------------------------------------------------------------
+bool name_less(const char* a, std::size_t an,
+               const char* b, std::size_t bn) noexcept
+{
+    const auto c = std::memcmp(a, b, std::min(an, bn));
+    return c < 0 || (c == 0 && an < bn);
+}
+
+
+//-------------------------------------------------------------------
+void write_bytes(std::FILE* file, const void* data, std::size_t size,
+                 std::uint64_t& pos, const string& filename)
+{
+    if(size > 0 && std::fwrite(data, 1, size, file) != size) {
+        throw file_write_error{"can't write file " + filename};
+    }
+    pos += size;
+}
+
+
+//-------------------------------------------------------------------
+void write_padding(std::FILE* file, std::uint64_t& pos, const string& filename)
+{
+    const char zeros[8] = {0};
+    write_bytes(file, zeros, (8 - pos % 8) % 8, pos, filename);
+}
+
+} // namespace
+
+
+
+//-------------------------------------------------------------------
+void packed_sequences::convert(const string& sequenceFile,
+                               const string& packedFile)
+{
+    auto reader = make_sequence_reader(sequenceFile);
+
+    const auto tmpFile = packedFile + ".tmp";
+    std::unique_ptr<std::FILE, int(*)(std::FILE*)> file {
+        std::fopen(tmpFile.c_str(), "wb"), std::fclose};
+    if(!file) {
+        throw file_access_error{"can't create file " + tmpFile};
+    }
+
+    file_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::uint64_t pos = 0;
+    write_bytes(file.get(), &header, sizeof(header), pos, tmpFile);
+
+    std::vector<file_record> records;
+    std::vector<file_interval> intervals;
+    std::vector<file_interval> nIntervals;
+    std::vector<file_interval> maskIntervals;
+    std::vector<unsigned char> packed;
+    string headers;
+
+    while(reader->has_next()) {
+        auto seq = reader->next();
+        if(seq.header.empty() && seq.data.empty()) continue;
+
+        const auto& data = seq.data;
+        nIntervals.clear();
+        maskIntervals.clear();
+        packed.assign((data.size() + 3) / 4, 0);
+
+        for(std::size_t p = 0; p < data.size(); ++p) {
+            const auto c = data[p];
+            auto code = base_code(c);
+            if(code > 3) {
+                add_position(nIntervals, p);
+                code = 0;
+            }
+            if(c >= 'a' && c <= 'z') add_position(maskIntervals, p);
+            packed[p / 4] |= (unsigned char)(code << (2 * (p % 4)));
+        }
+
+        file_record r;
+        r.length       = data.size();
+        r.basesOffset  = pos - sizeof(header);
+        r.headerOffset = headers.size();
+        r.headerSize   = seq.header.size();
+        r.firstN       = intervals.size();
+        r.numN         = nIntervals.size();
+        intervals.insert(intervals.end(), nIntervals.begin(), nIntervals.end());
+        r.firstMask    = intervals.size();
+        r.numMask      = maskIntervals.size();
+        intervals.insert(intervals.end(), maskIntervals.begin(), maskIntervals.end());
+        records.push_back(r);
+
+        headers += seq.header;
+        header.totalBases += data.size();
+
+        write_bytes(file.get(), packed.data(), packed.size(), pos, tmpFile);
+    }
+
+    std::vector<std::uint64_t> byName(records.size());
+    std::iota(byName.begin(), byName.end(), std::uint64_t(0));
+    std::stable_sort(byName.begin(), byName.end(),
+        [&](std::uint64_t a, std::uint64_t b) {
+            const auto& ra = records[a];
+            const auto& rb = records[b];
+            const char* ha = headers.data() + ra.headerOffset;
+            const char* hb = headers.data() + rb.headerOffset;
+            return name_less(ha, name_size(ha, ra.headerSize),
+                             hb, name_size(hb, rb.headerSize));
+        });
+
+    std::vector<std::uint64_t> byLength(records.size());
+    std::iota(byLength.begin(), byLength.end(), std::uint64_t(0));
+    std::stable_sort(byLength.begin(), byLength.end(),
+        [&](std::uint64_t a, std::uint64_t b) {
+            return records[a].length > records[b].length;
+        });
+
+    std::memcpy(header.magic, packed_magic, sizeof(packed_magic));
+    header.version      = packed_version;
+    header.byteOrder    = packed_byte_order;
+    header.records      = records.size();
+    header.basesBytes   = pos - sizeof(header);
+    header.intervals    = intervals.size();
+    header.headersBytes = headers.size();
+
+    write_padding(file.get(), pos, tmpFile);
+    header.recordsOffset = pos;
+    write_bytes(file.get(), records.data(),
+                records.size() * sizeof(file_record), pos, tmpFile);
+    header.intervalsOffset = pos;
+    write_bytes(file.get(), intervals.data(),
+                intervals.size() * sizeof(file_interval), pos, tmpFile);
+    header.byNameOffset = pos;
+    write_bytes(file.get(), byName.data(),
+                byName.size() * sizeof(std::uint64_t), pos, tmpFile);
+    header.byLengthOffset = pos;
+    write_bytes(file.get(), byLength.data(),
+                byLength.size() * sizeof(std::uint64_t), pos, tmpFile);
+    header.headersOffset = pos;
+    write_bytes(file.get(), headers.data(), headers.size(), pos, tmpFile);
+
+    std::uint64_t start = 0;
+    if(std::fseek(file.get(), 0, SEEK_SET) != 0) {
+        throw file_write_error{"can't write file " + tmpFile};
+    }
+    write_bytes(file.get(), &header, sizeof(header), start, tmpFile);
+
+    if(std::fclose(file.release()) != 0 ||
+       std::rename(tmpFile.c_str(), packedFile.c_str()) != 0)
+    {
+        std::remove(tmpFile.c_str());
+        throw file_write_error{"can't write file " + packedFile};
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+bool packed_sequences::is_packed(const string& filename)
+{
+    char magic[sizeof(packed_magic)] = {0};
+    std::FILE* file = std::fopen(filename.c_str(), "rb");
+    if(!file) return false;
+    const auto n = std::fread(magic, 1, sizeof(magic), file);
+    std::fclose(file);
+    return n == sizeof(magic) &&
+           std::memcmp(magic, packed_magic, sizeof(magic)) == 0;
+}
+
+
+
+//-------------------------------------------------------------------
+packed_sequences::packed_sequences(const string& packedFile):
+    file_{nullptr}, fileSize_{0},
+    header_{nullptr}, bases_{nullptr}, records_{nullptr}, intervals_{nullptr},
+    byName_{nullptr}, byLength_{nullptr}, names_{nullptr}
+{
+    //records are fetched in any order
+    file_ = map_file(packedFile, fileSize_, MADV_NORMAL);
+
+    header_ = reinterpret_cast<const file_header*>(file_);
+
+    const auto fits = [&](std::uint64_t offset, std::uint64_t count,
+                          std::uint64_t size)
+    {
+        return offset <= fileSize_ && count <= (fileSize_ - offset) / size;
+    };
+
+    if(fileSize_ < sizeof(file_header) ||
+       std::memcmp(header_->magic, packed_magic, sizeof(packed_magic)) != 0 ||
+       header_->version != packed_version ||
+       header_->byteOrder != packed_byte_order ||
+       !fits(sizeof(file_header), header_->basesBytes, 1) ||
+       !fits(header_->recordsOffset, header_->records, sizeof(file_record)) ||
+       !fits(header_->intervalsOffset, header_->intervals, sizeof(file_interval)) ||
+       !fits(header_->byNameOffset, header_->records, sizeof(std::uint64_t)) ||
+       !fits(header_->byLengthOffset, header_->records, sizeof(std::uint64_t)) ||
+       !fits(header_->headersOffset, header_->headersBytes, 1))
+    {
+        unmap_file(file_, fileSize_);
+        throw io_format_error{"not a packed sequence file: " + packedFile};
+    }
+
+    bases_     = reinterpret_cast<const unsigned char*>(file_ + sizeof(file_header));
+    records_   = reinterpret_cast<const file_record*>(file_ + header_->recordsOffset);
+    intervals_ = reinterpret_cast<const file_interval*>(file_ + header_->intervalsOffset);
+    byName_    = reinterpret_cast<const std::uint64_t*>(file_ + header_->byNameOffset);
+    byLength_  = reinterpret_cast<const std::uint64_t*>(file_ + header_->byLengthOffset);
+    names_     = file_ + header_->headersOffset;
+
+    //fetch and operator[] trust the records, so a corrupt file
+    //must not get past this point
+    const auto within = [](std::uint64_t first, std::uint64_t count,
+                           std::uint64_t total)
+    {
+        return first <= total && count <= total - first;
+    };
+    const auto intervals_valid = [&](std::uint64_t first, std::uint64_t num,
+                                     std::uint64_t length)
+    {
+        if(!within(first, num, header_->intervals)) return false;
+        std::uint64_t last = 0;
+        for(auto iv = intervals_ + first; iv != intervals_ + first + num; ++iv) {
+            if(iv->begin < last || iv->begin >= iv->end || iv->end > length) return false;
+            last = iv->end;
+        }
+        return true;
+    };
+
+    bool valid = header_->recordsOffset % 8 == 0 &&
+                 header_->intervalsOffset % 8 == 0 &&
+                 header_->byNameOffset % 8 == 0 &&
+                 header_->byLengthOffset % 8 == 0;
+
+    std::uint64_t totalBases = 0;
+    for(std::uint64_t i = 0; valid && i < header_->records; ++i) {
+        const auto& r = records_[i];
+        valid = within(r.basesOffset, r.length / 4 + (r.length % 4 != 0),
+                       header_->basesBytes) &&
+                within(r.headerOffset, r.headerSize, header_->headersBytes) &&
+                intervals_valid(r.firstN, r.numN, r.length) &&
+                intervals_valid(r.firstMask, r.numMask, r.length) &&
+                byName_[i] < header_->records &&
+                byLength_[i] < header_->records;
+        totalBases += r.length;
+    }
+
+    if(!valid || totalBases != header_->totalBases) {
+        unmap_file(file_, fileSize_);
+        throw io_format_error{"corrupt packed sequence file: " + packedFile};
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+packed_sequences::~packed_sequences()
+{
+    unmap_file(file_, fileSize_);
+}
+
+
+
+//-------------------------------------------------------------------
+std::size_t packed_sequences::size() const noexcept
+{
+    return std::size_t(header_->records);
+}
+
+
+//-------------------------------------------------------------------
+std::uint64_t packed_sequences::total_bases() const noexcept
+{
+    return header_->totalBases;
+}
+
+
+
+//-------------------------------------------------------------------
+string packed_sequences::record::name() const
+{
+    return string(header, name_size(header, header_size));
+}
+
+
+
+//-------------------------------------------------------------------
+packed_sequences::record
+packed_sequences::operator [] (std::size_t i) const noexcept
+{
+    const auto& r = records_[i];
+    return record{names_ + r.headerOffset, std::size_t(r.headerSize), r.length};
+}
+
+
+
+//-------------------------------------------------------------------
+std::size_t packed_sequences::by_length(std::size_t k) const noexcept
+{
+    return std::size_t(byLength_[k]);
+}
+
+
+
+//-------------------------------------------------------------------
+std::size_t packed_sequences::find(const string& name) const
+{
+    const auto name_of = [this](std::uint64_t i) {
+        const auto& r = records_[i];
+        const char* h = names_ + r.headerOffset;
+        return std::make_pair(h, name_size(h, r.headerSize));
+    };
+
+    const auto last = byName_ + size();
+    const auto i = std::lower_bound(byName_, last, name,
+        [&](std::uint64_t rec, const string& n) {
+            const auto a = name_of(rec);
+            return name_less(a.first, a.second, n.data(), n.size());
+        });
+
+    if(i == last) return size();
+    const auto a = name_of(*i);
+    if(a.second != name.size() ||
+       std::memcmp(a.first, name.data(), name.size()) != 0)
+    {
+        return size();
+    }
+    return std::size_t(*i);
+}
+
+
+
+//-------------------------------------------------------------------
+string packed_sequences::fetch(std::size_t record) const
+{
+    if(record >= size()) {
+        throw std::out_of_range{"packed record number out of range"};
+    }
+    return fetch(record, 0, records_[record].length);
+}
+
+
+
+//-------------------------------------------------------------------
+string packed_sequences::fetch(std::size_t record,
+                               std::uint64_t begin, std::uint64_t end) const
+{
+    if(record >= size()) {
+        throw std::out_of_range{"packed record number out of range"};
+    }
+    const auto& r = records_[record];
+
+    end = std::min(end, r.length);
+    if(begin >= end) return string{};
+
+    string seq;
+    seq.resize(end - begin);
+
+    const auto bases = bases_ + r.basesOffset;
+    const auto table = unpacked_bytes();
+    char* out = &seq[0];
+    auto p = begin;
+    for(; p < end && (p % 4) != 0; ++p) {
+        *out++ = table[4 * bases[p / 4] + p % 4];
+    }
+    for(; p + 4 <= end; p += 4, out += 4) {
+        std::memcpy(out, table + 4 * bases[p / 4], 4);
+    }
+    for(; p < end; ++p) {
+        *out++ = table[4 * bases[p / 4] + p % 4];
+    }
+
+    //N before lower case, so masked N come out as 'n'
+    for_each_overlap(intervals_ + r.firstN, r.numN, begin, end,
+        [&](std::uint64_t from, std::uint64_t to) {
+            std::fill(&seq[from - begin], &seq[0] + (to - begin), 'N');
+        });
+    for_each_overlap(intervals_ + r.firstMask, r.numMask, begin, end,
+        [&](std::uint64_t from, std::uint64_t to) {
+            for(auto i = from - begin; i < to - begin; ++i) {
+                seq[i] = char(seq[i] - 'A' + 'a');
+            }
+        });
+
+    return seq;
+}
+
+
+
+//-------------------------------------------------------------------
+string packed_sequences::fetch(const string& name,
+                               std::uint64_t begin, std::uint64_t end) const
+{
+    const auto record = find(name);
+    if(record >= size()) {
+        throw std::out_of_range{"unknown packed record " + name};
+    }
+    return fetch(record, begin, end);
+}
+
+
+
+//-------------------------------------------------------------------
+string packed_sequences::fetch_region(const string& region) const
+{
+    return fetch_source_region(*this, region);
+}
+
+
+
+//-------------------------------------------------------------------
+fastq_reader::fastq_reader(string filename):
+    sequence_reader{},
+    buffer_{open_sequence_file(filename)},
+    file_{buffer_.get()},
+    line_{}
+{
+    if(!buffer_) {
+        invalidate();
+        throw file_access_error{"can't open file " + filename};
+    }
+    //decompression errors are thrown from the stream buffer
+    file_.exceptions(std::ios::badbit);
+}
+
+
+
+//-------------------------------------------------------------------
+fastq_reader::fastq_reader(std::unique_ptr<std::streambuf> buffer):
+    sequence_reader{},
+    buffer_{std::move(buffer)},
+    file_{buffer_.get()},
+    line_{}
+{
+    if(!buffer_) {
+        invalidate();
+        throw file_access_error{"no input buffer"};
+    }
+    file_.exceptions(std::ios::badbit);
+}
+
+
+
+//-------------------------------------------------------------------
+void fastq_reader::read_next(sequence& seq)
+{
+    if(!file_.good()) {
+        invalidate();
+        return;
+    }
+
+    getline(file_, line_);
+    if(line_.empty()) {
+        invalidate();
+        return;
+    }
+    if(line_[0] != '@') {
+        if(line_[0] != '\r') {
+            throw io_format_error{"malformed fastq file - sequence header: "  + line_};
+        }
+        invalidate();
+        return;
+    }
+    seq.header.assign(line_, 1, string::npos);
+    getline(file_, seq.data);
+
+    getline(file_, line_);
+    if(line_.empty() || line_[0] != '+') {
+        if(line_[0] != '\r') {
+            throw io_format_error{"malformed fastq file - quality header: "  + line_};
+        }
+        invalidate();
+        return;
+    }
+    getline(file_, seq.qualities);
+}
+
+
+
+
+//-------------------------------------------------------------------
+sequence_header_reader::sequence_header_reader(string filename):
+    buffer_{open_sequence_file(filename)},
+    file_{buffer_.get()},
+    line_{}
+{
+    if(!buffer_) {
+        invalidate();
+        throw file_access_error{"can't open file " + filename};
+    }
+    //decompression errors are thrown from the stream buffer
+    file_.exceptions(std::ios::badbit);
+}
+
+
+
+//-------------------------------------------------------------------
+void sequence_header_reader::read_next(sequence& seq)
+{
+
+    bool headerFound = false;
+    do {
+        if(!file_.good()) {
+            invalidate();
+            return;
+        }
+
+        getline(file_, line_);
+
+        headerFound = line_[0] == '>' || line_[0] == '@';
+        if(headerFound) {
+            seq.header.assign(line_, 1, string::npos);
+        }
+    } while(!headerFound);
+}
+
+
+
+//-------------------------------------------------------------------
+packed_sequence_reader::packed_sequence_reader(string filename):
+    sequence_reader{},
+    store_{filename},
+    next_{0}
+{
+    if(store_.empty()) invalidate();
+}
+
+
+
+//-------------------------------------------------------------------
+void packed_sequence_reader::read_next(sequence& seq)
+{
+    if(next_ >= store_.size()) {
+        invalidate();
+        return;
+    }
+    const auto r = store_[next_];
+    seq.header.assign(r.header, r.header_size);
+    seq.data = store_.fetch(next_);
+    seq.qualities.clear();
+
+    if(++next_ >= store_.size()) invalidate();
+}
+
+
+
+//-------------------------------------------------------------------
+namespace {
+
+/// @brief mapped_fasta may keep a copy of all sequence bytes,
+///        so larger files are read line by line
+constexpr std::uint64_t max_mapped_fasta_size = std::uint64_t(4) << 30;
+
+/// @brief regular (mappable) file that starts with a FASTA header
+bool is_plain_fasta(const string& filename)
+{
+    struct stat info;
+    if(stat(filename.c_str(), &info) != 0 || !S_ISREG(info.st_mode) ||
+       info.st_size < 1 || std::uint64_t(info.st_size) > max_mapped_fasta_size)
+    {
+        return false;
+    }
+    std::FILE* file = std::fopen(filename.c_str(), "rb");
+    if(!file) return false;
+    const auto first = std::fgetc(file);
+    std::fclose(file);
+    return first == '>';
+}
+
+} // namespace
+
+
+
+//-------------------------------------------------------------------
+std::unique_ptr<sequence_reader>
+make_sequence_reader(const string& filename)
+{
+    //the format of the standard input is known after the first character
+    if(filename == "-") {
+        auto buffer = open_sequence_file(filename);
+        const auto first = buffer->sgetc();
+        if(first == '>') {
+            return std::unique_ptr<sequence_reader>{new fasta_reader{std::move(buffer)}};
+        }
+        else if(first == '@') {
+            return std::unique_ptr<sequence_reader>{new fastq_reader{std::move(buffer)}};
+        }
+        throw file_read_error{"input format not recognized"};
+    }
+
+    //compressed files are recognized by their content
+    auto name = filename;
+    for(auto ext : {".gz", ".bgz", ".bgzf"}) {
+        const auto len = std::strlen(ext);
+        if(name.size() > len && name.compare(name.size() - len, len, ext) == 0) {
+            name.resize(name.size() - len);
+            break;
+        }
+    }
+
+    auto n = name.size();
+    if(name.find(".fq")    == (n-3) ||
+       name.find(".fnq")   == (n-4) ||
+       name.find(".fastq") == (n-6) )
+    {
+        return std::unique_ptr<sequence_reader>{new fastq_reader{filename}};
+    }
+    else if(name.find(".fa")    == (n-3) ||
+            name.find(".fna")   == (n-4) ||
+            name.find(".fasta") == (n-6) )
+    {
+        return std::unique_ptr<sequence_reader>{new fasta_reader{filename}};
+    }
+
+    //try to determine file type content
+    if(packed_sequences::is_packed(filename)) {
+        return std::unique_ptr<sequence_reader>{new packed_sequence_reader{filename}};
+    }
+
+    auto buffer = open_sequence_file(filename);
+    if(buffer) {
+        std::istream is {buffer.get()};
+        const auto first = is.peek();
+        if(first == '>') {
+            return std::unique_ptr<sequence_reader>{new fasta_reader{filename}};
+        }
+        else if(first == '@') {
+            return std::unique_ptr<sequence_reader>{new fastq_reader{filename}};
+        }
+        throw file_read_error{"file format not recognized"};
+    }
+
+    throw file_access_error{"file not accessible"};
+    return nullptr;
+}
+
+
+
+//-------------------------------------------------------------------
+sequence_records::sequence_records(sequence_reader& reader):
+    mapped_{}, batch_{}, records_{}
+{
+    read(reader);
+}
+
+
+//-------------------------------------------------------------------
+sequence_records::sequence_records(const string& filename):
+    mapped_{}, batch_{}, records_{}
+{
+    if(!is_plain_fasta(filename)) {
+        read(*make_sequence_reader(filename));
+        return;
+    }
+    mapped_.reset(new mapped_fasta{filename});
+    records_.reserve(mapped_->size());
+    for(const auto& r : *mapped_) {
+        records_.push_back(record{r.header, r.header_size, r.data, r.size, nullptr, 0});
+    }
+}
+
+
+//-------------------------------------------------------------------
+void sequence_records::read(sequence_reader& reader)
+{
+    while(reader.has_next()) {
+        auto seq = reader.next();
+        if(!seq.header.empty() || !seq.data.empty()) batch_.push_back(seq);
+    }
+    //views are taken when the batch doesn't grow any more
+    records_.reserve(batch_.size());
+    for(std::size_t i = 0; i < batch_.size(); ++i) {
+        records_.push_back(record{
+            batch_.header(i), batch_.header_size(i),
+            batch_.data(i), batch_.data_size(i),
+            batch_.qualities(i), batch_.qualities_size(i)});
+    }
+}
+
 } // namespace anyseq
 
@@ -4,11 +4,17 @@
 
 #include <atomic>
 #include <cstdint>
-#include <fstream>
+#include <exception>
+#include <istream>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
+#include "bounded_queue.h"
+#include "compressed_io.h"
 #include "io_error.h"
 
 
@@ -20,6 +26,8 @@ namespace anyseq {
  * @brief polymorphic file reader for bio-sequences
  *        base class handles concurrency safety
  *
+ *        the file based readers accept plain, gzip and BGZF files
+ *
  *****************************************************************************/
 class sequence_reader
 {
@@ -33,6 +41,46 @@ public:
         std::string qualities;   //quality scores (FASTQ)
     };
 
+    /**
+     * @brief reusable structure-of-arrays storage for several sequences;
+     *        the header, data and qualities of all sequences are stored
+     *        back to back in one byte buffer
+     */
+    class batch {
+    public:
+        std::size_t size() const noexcept { return indices_.size(); }
+        bool empty() const noexcept { return indices_.empty(); }
+
+        /** @brief keeps the capacity */
+        void clear() noexcept;
+
+        void push_back(const sequence&);
+        /** @brief copies sequence i of another batch */
+        void push_back(const batch&, std::size_t i);
+
+        index_type index(std::size_t i) const noexcept { return indices_[i]; }
+
+        const char* header(std::size_t i) const noexcept { return begin(i, 0); }
+        const char* data(std::size_t i) const noexcept { return begin(i, 1); }
+        const char* qualities(std::size_t i) const noexcept { return begin(i, 2); }
+
+        std::size_t header_size(std::size_t i) const noexcept { return length(i, 0); }
+        std::size_t data_size(std::size_t i) const noexcept { return length(i, 1); }
+        std::size_t qualities_size(std::size_t i) const noexcept { return length(i, 2); }
+
+    private:
+        const char* begin(std::size_t i, int field) const noexcept {
+            return bytes_.data() + offsets_[3*i + field];
+        }
+        std::size_t length(std::size_t i, int field) const noexcept {
+            return offsets_[3*i + field + 1] - offsets_[3*i + field];
+        }
+
+        std::vector<index_type> indices_;
+        std::vector<char> bytes_;
+        std::vector<std::size_t> offsets_ {0};  //3 per sequence + 1
+    };
+
     sequence_reader(): index_{0}, valid_{true} {}
 
     sequence_reader(const sequence_reader&) = delete;
@@ -44,6 +92,15 @@ public:
     /** @brief read & return next sequence */
     sequence next();
 
+    /** @brief replaces the content of 'b' with up to 'n' next sequences;
+     *         takes the lock once per batch and reuses the storage of 'b'
+     *         and of one internal sequence; returns the number of sequences
+     *
+     *         concurrent consumers take turns on the reader's lock while
+     *         a batch is parsed; batch_prefetcher parses ahead on its own
+     *         thread and hands batches out without the lock */
+    std::size_t next_batch(batch& b, std::size_t n);
+
     /** @brief skip n sequences */
     void skip(index_type n);
 
@@ -53,6 +110,9 @@ public:
 
     void index_offset(index_type index) { index_.store(index); }
 
+    /** @brief time spent reading the input ahead of the consumers */
+    virtual readahead_statistics io_statistics() const { return {}; }
+
 protected:
     void invalidate() { valid_.store(false); }
 
@@ -61,12 +121,62 @@ protected:
 
 private:
     mutable std::mutex mutables_;
+    sequence scratch_;
     std::atomic<index_type> index_;
     std::atomic<bool> valid_;
 };
 
 
 
+/*************************************************************************//**
+ *
+ * @brief parses batches of a sequence reader ahead of its consumers
+ *
+ *        a producer thread fills a fixed number of batches with
+ *        sequence_reader::next_batch and passes them through a lock-free
+ *        bounded_queue; any number of consumers take them from there
+ *        and give back their old storage, so reading stalls as soon as
+ *        all batches wait for consumers
+ *
+ *        the reader must not be used otherwise while the prefetcher
+ *        exists; a read error is rethrown by next_batch once all
+ *        batches before it were taken
+ *
+ *****************************************************************************/
+class batch_prefetcher
+{
+public:
+    using batch = sequence_reader::batch;
+
+    /** @brief starts reading batches of up to 'batchSize' sequences */
+    batch_prefetcher(sequence_reader&, std::size_t batchSize,
+                     std::size_t batches = 4);
+
+    batch_prefetcher(const batch_prefetcher&) = delete;
+    batch_prefetcher& operator = (const batch_prefetcher&) = delete;
+
+    /** @brief stops reading; waits for the batch that is being parsed */
+    ~batch_prefetcher();
+
+    /** @brief replaces the content of 'b' with the next batch and keeps
+     *         the storage of 'b' for later batches; waits while no batch
+     *         is ready; returns the number of sequences, 0 at the end */
+    std::size_t next_batch(batch& b);
+
+private:
+    void read();
+
+    sequence_reader& reader_;
+    std::size_t batchSize_;
+    bounded_queue<std::unique_ptr<batch>> free_;
+    bounded_queue<std::unique_ptr<batch>> full_;
+    std::atomic<bool> stop_;
+    std::exception_ptr error_;
+    std::thread producer_;
+};
+
+
+
 /*************************************************************************//**
  *
  * @brief reads sequences from FASTA files
@@ -79,16 +189,273 @@ public:
     explicit
     fasta_reader(std::string filename);
 
+    /** @brief reads from an opened buffer, e.g. of the standard input */
+    explicit
+    fasta_reader(std::unique_ptr<std::streambuf>);
+
+    readahead_statistics io_statistics() const override {
+        return statistics(buffer_.get());
+    }
+
 protected:
     void read_next(sequence&) override;
 
 private:
-    std::ifstream file_;
+    std::unique_ptr<std::streambuf> buffer_;
+    std::istream file_;
+    std::string line_;
     std::string linebuffer_;
 };
 
 
 
+/*************************************************************************//**
+ *
+ * @brief all records of a FASTA file at once
+ *
+ *        the file is memory-mapped; record boundaries and line ends are
+ *        found with memchr; headers and sequences on a single line point
+ *        into the mapping, the lines of other sequences are joined in
+ *        parallel into one buffer; records are views that live as long
+ *        as the object
+ *
+ *****************************************************************************/
+class mapped_fasta
+{
+public:
+    struct record {
+        const char* header;         //without '>' and line end
+        std::size_t header_size;
+        const char* data;           //sequence without line breaks
+        std::size_t size;
+
+        std::string header_string() const { return {header, header_size}; }
+        std::string data_string() const { return {data, size}; }
+    };
+
+    using const_iterator = std::vector<record>::const_iterator;
+
+    /** @brief uses std::thread::hardware_concurrency() threads if 0 */
+    explicit
+    mapped_fasta(const std::string& filename, unsigned threads = 0);
+
+    mapped_fasta(const mapped_fasta&) = delete;
+    mapped_fasta& operator = (const mapped_fasta&) = delete;
+
+    ~mapped_fasta();
+
+    std::size_t size() const noexcept { return records_.size(); }
+    bool empty() const noexcept { return records_.empty(); }
+
+    const record& operator [] (std::size_t i) const noexcept { return records_[i]; }
+
+    const_iterator begin() const noexcept { return records_.begin(); }
+    const_iterator end() const noexcept { return records_.end(); }
+
+private:
+    void join_lines(unsigned threads);
+
+    const char* file_;
+    std::size_t fileSize_;
+    std::unique_ptr<char[]> data_;
+    std::vector<record> records_;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief FASTA index in the samtools .fai format
+ *
+ *        one entry per record with the sequence length, the file offset
+ *        of its first base and the number of bases and bytes per line;
+ *        all lines of a record but the last must have the same length
+ *
+ *****************************************************************************/
+class fasta_index
+{
+public:
+    struct entry {
+        std::string   name;         //header up to the first white space
+        std::uint64_t length;
+        std::uint64_t offset;
+        std::uint64_t lineBases;
+        std::uint64_t lineWidth;    //including the line end
+    };
+
+    using const_iterator = std::vector<entry>::const_iterator;
+
+    /** @brief scans a plain FASTA file with one thread per chunk of lines;
+     *         uses std::thread::hardware_concurrency() threads if 0 */
+    static fasta_index build(const std::string& fastaFile, unsigned threads = 0);
+
+    static fasta_index load(const std::string& faiFile);
+
+    void save(const std::string& faiFile) const;
+
+    void push_back(entry);
+
+    std::size_t size() const noexcept { return entries_.size(); }
+    bool empty() const noexcept { return entries_.empty(); }
+
+    const entry& operator [] (std::size_t i) const noexcept { return entries_[i]; }
+
+    /** @brief number of the record with the given name or size() */
+    std::size_t find(const std::string& name) const;
+
+    const_iterator begin() const noexcept { return entries_.begin(); }
+    const_iterator end() const noexcept { return entries_.end(); }
+
+private:
+    std::vector<entry> entries_;
+    std::unordered_map<std::string,std::size_t> byName_;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief random access to the records of a plain FASTA file
+ *
+ *        uses 'filename'.fai if it is not older than the FASTA file,
+ *        otherwise builds the index and tries to save it there;
+ *        each fetch reads one contiguous byte range
+ *
+ *****************************************************************************/
+class indexed_fasta
+{
+public:
+    explicit
+    indexed_fasta(const std::string& filename, unsigned threads = 0);
+
+    indexed_fasta(const indexed_fasta&) = delete;
+    indexed_fasta& operator = (const indexed_fasta&) = delete;
+
+    ~indexed_fasta();
+
+    const fasta_index& index() const noexcept { return index_; }
+
+    std::size_t size() const noexcept { return index_.size(); }
+
+    /** @brief whole record; throws std::out_of_range for invalid numbers */
+    std::string fetch(std::size_t record) const;
+
+    /** @brief bases [begin,end) of a record; 'end' is clamped */
+    std::string fetch(std::size_t record,
+                      std::uint64_t begin, std::uint64_t end) const;
+
+    /** @brief bases [begin,end) of the record with the given name;
+     *         throws std::out_of_range for unknown names */
+    std::string fetch(const std::string& name,
+                      std::uint64_t begin, std::uint64_t end) const;
+
+    /** @brief number of the record with the given name or size() */
+    std::size_t find(const std::string& name) const { return index_.find(name); }
+
+    /** @brief samtools-style region "name" or "name:begin-end" with
+     *         1-based, inclusive coordinates */
+    std::string fetch_region(const std::string& region) const;
+
+private:
+    int fd_;
+    fasta_index index_;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief read-only store of 2-bit packed sequences
+ *
+ *        the file holds the packed bases (4 per byte, each record starts
+ *        at a byte boundary), per record intervals of N and of lower
+ *        case (soft-masked) bases, the record headers, the record numbers
+ *        ordered by name and ordered by decreasing length;
+ *        letters other than ACGT are stored as N like in UCSC .2bit files
+ *
+ *        the file is memory-mapped as a whole and used without parsing,
+ *        so opening is independent of the sequence lengths and processes
+ *        share the pages of the same file
+ *
+ *****************************************************************************/
+class packed_sequences
+{
+public:
+    struct record {
+        const char* header;         //without '>' and line end
+        std::size_t header_size;
+        std::uint64_t length;
+
+        std::string header_string() const { return {header, header_size}; }
+        /** @brief header up to the first white space */
+        std::string name() const;
+    };
+
+    /** @brief packs all sequences that make_sequence_reader can read;
+     *         the file is written under a temporary name and renamed */
+    static void convert(const std::string& sequenceFile,
+                        const std::string& packedFile);
+
+    /** @brief true if the file starts like a packed sequence file */
+    static bool is_packed(const std::string& filename);
+
+    /** @brief throws io_format_error if the file is not a packed store
+     *         or any of its records points outside of its sections */
+    explicit
+    packed_sequences(const std::string& packedFile);
+
+    packed_sequences(const packed_sequences&) = delete;
+    packed_sequences& operator = (const packed_sequences&) = delete;
+
+    ~packed_sequences();
+
+    std::size_t size() const noexcept;
+    bool empty() const noexcept { return size() == 0; }
+
+    std::uint64_t total_bases() const noexcept;
+
+    /** @brief record number i in file order */
+    record operator [] (std::size_t i) const noexcept;
+
+    /** @brief number of the k-th longest record */
+    std::size_t by_length(std::size_t k) const noexcept;
+
+    /** @brief number of the record with the given name or size() */
+    std::size_t find(const std::string& name) const;
+
+    /** @brief whole record; throws std::out_of_range for invalid numbers */
+    std::string fetch(std::size_t record) const;
+
+    /** @brief bases [begin,end) of a record; 'end' is clamped */
+    std::string fetch(std::size_t record,
+                      std::uint64_t begin, std::uint64_t end) const;
+
+    /** @brief bases [begin,end) of the record with the given name;
+     *         throws std::out_of_range for unknown names */
+    std::string fetch(const std::string& name,
+                      std::uint64_t begin, std::uint64_t end) const;
+
+    /** @brief region "name" or "name:begin-end" (1-based, inclusive) */
+    std::string fetch_region(const std::string& region) const;
+
+private:
+    struct file_header;
+    struct file_record;
+    struct file_interval;
+
+    const char* file_;
+    std::size_t fileSize_;
+    const file_header* header_;
+    const unsigned char* bases_;
+    const file_record* records_;
+    const file_interval* intervals_;
+    const std::uint64_t* byName_;
+    const std::uint64_t* byLength_;
+    const char* names_;
+};
+
+
+
 /*************************************************************************//**
  *
  * @brief reads sequences from FASTQ files
@@ -101,11 +468,21 @@ public:
     explicit
     fastq_reader(std::string filename);
 
+    /** @brief reads from an opened buffer, e.g. of the standard input */
+    explicit
+    fastq_reader(std::unique_ptr<std::streambuf>);
+
+    readahead_statistics io_statistics() const override {
+        return statistics(buffer_.get());
+    }
+
 protected:
     void read_next(sequence&) override;
 
 private:
-    std::ifstream file_;
+    std::unique_ptr<std::streambuf> buffer_;
+    std::istream file_;
+    std::string line_;
 };
 
 
@@ -122,11 +499,39 @@ public:
     explicit
     sequence_header_reader(std::string filename);
 
+    readahead_statistics io_statistics() const override {
+        return statistics(buffer_.get());
+    }
+
 protected:
     void read_next(sequence&) override;
 
 private:
-    std::ifstream file_;
+    std::unique_ptr<std::streambuf> buffer_;
+    std::istream file_;
+    std::string line_;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief reads the records of a packed sequence file in file order
+ *
+ *****************************************************************************/
+class packed_sequence_reader :
+    public sequence_reader
+{
+public:
+    explicit
+    packed_sequence_reader(std::string filename);
+
+protected:
+    void read_next(sequence&) override;
+
+private:
+    packed_sequences store_;
+    std::size_t next_;
 };
 
 
@@ -134,7 +539,8 @@ private:
 /*************************************************************************//**
  *
  * @brief guesses and returns a suitable sequence reader
- *        based on a filename pattern
+ *        based on a filename pattern or the file content;
+ *        "-" reads FASTA or FASTQ from the standard input
  *
  *****************************************************************************/
 std::unique_ptr<sequence_reader>
@@ -142,6 +548,58 @@ make_sequence_reader(const std::string& filename);
 
 
 
+/*************************************************************************//**
+ *
+ * @brief all records of an input at once, e.g. reference records
+ *
+ *        plain FASTA files of up to 4 GiB are loaded by mapped_fasta and
+ *        the records are views into it; other inputs are read record by
+ *        record into a batch; empty records are left out
+ *
+ *****************************************************************************/
+class sequence_records
+{
+public:
+    struct record {
+        const char* header;
+        std::size_t header_size;
+        const char* data;
+        std::size_t size;
+        const char* qualities;      //FASTQ only
+        std::size_t qualities_size;
+    };
+
+    using const_iterator = std::vector<record>::const_iterator;
+
+    /** @brief reads the remaining records of 'reader' */
+    explicit
+    sequence_records(sequence_reader& reader);
+
+    /** @brief see make_sequence_reader for the supported inputs */
+    explicit
+    sequence_records(const std::string& filename);
+
+    sequence_records(const sequence_records&) = delete;
+    sequence_records& operator = (const sequence_records&) = delete;
+
+    std::size_t size() const noexcept { return records_.size(); }
+    bool empty() const noexcept { return records_.empty(); }
+
+    const record& operator [] (std::size_t i) const noexcept { return records_[i]; }
+
+    const_iterator begin() const noexcept { return records_.begin(); }
+    const_iterator end() const noexcept { return records_.end(); }
+
+private:
+    void read(sequence_reader&);
+
+    std::unique_ptr<mapped_fasta> mapped_;
+    sequence_reader::batch batch_;
+    std::vector<record> records_;
+};
+
+
+
 } // namespace anyseq
 
 
@@ -0,0 +1,133 @@
+#include "session.h"
+
+
+namespace anyseq {
+
+
+//-------------------------------------------------------------------
+alignment_session::alignment_session(alignment_kind kind,
+                                     const char* query, std::size_t lenq,
+                                     const char* subject, std::size_t lens,
+                                     workspace* ws)
+:
+    kind_{kind},
+    query_{query}, lenq_{lenq},
+    subject_{subject}, lens_{lens},
+    ownWs_{},
+    ws_{ws ? ws : &ownWs_},
+    scored_{false},
+    score_{0},
+    range_{-1, -1, -1, -1}
+{
+    check_lengths(lenq, lens);
+}
+
+
+//-------------------------------------------------------------------
+alignment_session::alignment_session(alignment_kind kind,
+                                     const std::string& query,
+                                     const std::string& subject,
+                                     workspace* ws)
+:
+    alignment_session{kind, query.c_str(), query.size(),
+                      subject.c_str(), subject.size(), ws}
+{}
+
+
+
+//-------------------------------------------------------------------
+score_t alignment_session::score()
+{
+    if(scored_) return score_;
+
+    switch(kind_) {
+        case alignment_kind::global:
+            score_ = global_alignment_score_end_ws(
+                query_, length_q(), subject_, length_s(), &range_, ws_);
+            break;
+        case alignment_kind::semiglobal:
+            score_ = semiglobal_alignment_score_end_ws(
+                query_, length_q(), subject_, length_s(), &range_, ws_);
+            break;
+        case alignment_kind::local:
+            score_ = local_alignment_score_end_ws(
+                query_, length_q(), subject_, length_s(), &range_, ws_);
+            break;
+    }
+    scored_ = true;
+    return score_;
+}
+
+
+
+//-------------------------------------------------------------------
+const anyseq_alignment_range& alignment_session::range()
+{
+    score();
+    return range_;
+}
+
+
+
+//-------------------------------------------------------------------
+score_t alignment_session::alignment(std::string& alQuery, std::string& alSubject)
+{
+    alQuery.resize(lenq_ + lens_, ' ');
+    alSubject.resize(lenq_ + lens_, ' ');
+
+    //global alignments are computed without a separate score pass
+    switch(kind_) {
+        case alignment_kind::global:
+            return construct_global_alignment_ws(
+                query_, length_q(), subject_, length_s(),
+                &alQuery.front(), &alSubject.front(), ws_);
+        case alignment_kind::semiglobal:
+            return construct_semiglobal_alignment_from_range(
+                query_, length_q(), subject_, length_s(), score(), &range_,
+                &alQuery.front(), &alSubject.front(), ws_);
+        case alignment_kind::local:
+            return construct_local_alignment_from_range(
+                query_, length_q(), subject_, length_s(), score(), &range_,
+                &alQuery.front(), &alSubject.front(), ws_);
+    }
+    return score_;
+}
+
+
+
+//-------------------------------------------------------------------
+score_t alignment_session::cigar(std::vector<std::uint32_t>& cigar,
+                                 anyseq_alignment_info& info)
+{
+    cigar.resize(lenq_ + lens_);
+
+    score_t sco = 0;
+    switch(kind_) {
+        case alignment_kind::global:
+            sco = global_alignment_cigar_ws(
+                query_, length_q(), subject_, length_s(),
+                cigar.data(), &info, ws_);
+            break;
+        case alignment_kind::semiglobal:
+            sco = semiglobal_alignment_cigar_from_range(
+                query_, length_q(), subject_, length_s(), score(), &range_,
+                cigar.data(), &info, ws_);
+            break;
+        case alignment_kind::local:
+            sco = local_alignment_cigar_from_range(
+                query_, length_q(), subject_, length_s(), score(), &range_,
+                cigar.data(), &info, ws_);
+            break;
+    }
+    cigar.resize(info.cigar_length);
+
+    //later tracebacks can skip the search for the alignment start
+    if(kind_ != alignment_kind::global && info.cigar_length > 0) {
+        range_.query_begin   = info.query_begin;
+        range_.subject_begin = info.subject_begin;
+    }
+    return sco;
+}
+
+
+} // namespace anyseq
@@ -0,0 +1,83 @@
+#ifndef ANYSEQ_SESSION_H_
+#define ANYSEQ_SESSION_H_
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "import.h"
+#include "workspace.h"
+
+
+namespace anyseq {
+
+
+enum class alignment_kind : int { global, semiglobal, local };
+
+
+/*************************************************************************//**
+ *
+ * @brief alignment of one sequence pair with lazily computed results
+ *
+ *        the score pass runs at most once and keeps the score and the
+ *        alignment's end cell; a traceback requested afterwards starts
+ *        from there instead of repeating the score pass, and the begin
+ *        coordinates found by a CIGAR traceback are reused by later ones;
+ *        the temporary buffers of all passes come from one workspace
+ *
+ *        the sequences are not copied and must outlive the session
+ *
+ *****************************************************************************/
+class alignment_session
+{
+public:
+    /** @brief uses an own workspace if 'ws' is null */
+    alignment_session(alignment_kind,
+                      const char* query, std::size_t lenq,
+                      const char* subject, std::size_t lens,
+                      workspace* ws = nullptr);
+
+    alignment_session(alignment_kind,
+                      const std::string& query, const std::string& subject,
+                      workspace* ws = nullptr);
+
+    alignment_session(const alignment_session&) = delete;
+    alignment_session& operator = (const alignment_session&) = delete;
+
+    alignment_kind kind() const noexcept { return kind_; }
+
+    /** @brief runs the score pass on first use */
+    score_t score();
+
+    /** @brief half-open aligned ranges; the begins are -1 until known */
+    const anyseq_alignment_range& range();
+
+    /** @brief gapped alignment strings with lenq + lens characters each,
+     *         right-aligned like the construct_*_alignment output */
+    score_t alignment(std::string& alQuery, std::string& alSubject);
+
+    /** @brief run-length encoded alignment, see *_alignment_cigar */
+    score_t cigar(std::vector<std::uint32_t>& cigar, anyseq_alignment_info& info);
+
+private:
+    int length_q() const noexcept { return int(lenq_); }
+    int length_s() const noexcept { return int(lens_); }
+
+    alignment_kind kind_;
+    const char* query_;
+    std::size_t lenq_;
+    const char* subject_;
+    std::size_t lens_;
+    workspace ownWs_;
+    workspace* ws_;
+    bool scored_;
+    score_t score_;
+    anyseq_alignment_range range_;
+};
+
+
+} // namespace anyseq
+
+
+#endif
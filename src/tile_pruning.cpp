@@ -0,0 +1,65 @@
+#include <atomic>
+
+#include "tile_pruning.h"
+
+
+namespace anyseq {
+
+namespace {
+
+//-------------------------------------------------------------------
+struct tile_pruning_counters {
+    std::atomic<std::uint64_t> alignments{0};
+    std::atomic<std::uint64_t> blocks{0};
+    std::atomic<std::uint64_t> skipped{0};
+    std::atomic<std::uint64_t> reruns{0};
+};
+
+tile_pruning_counters& counters()
+{
+    static tile_pruning_counters c;
+    return c;
+}
+
+} // namespace
+
+
+
+//-------------------------------------------------------------------
+tile_pruning_statistics tile_pruning_totals()
+{
+    const auto& c = counters();
+    tile_pruning_statistics stats;
+    stats.alignments = c.alignments.load();
+    stats.blocks = c.blocks.load();
+    stats.skipped = c.skipped.load();
+    stats.reruns = c.reruns.load();
+    return stats;
+}
+
+
+//-------------------------------------------------------------------
+void reset_tile_pruning_totals()
+{
+    auto& c = counters();
+    c.alignments.store(0);
+    c.blocks.store(0);
+    c.skipped.store(0);
+    c.reruns.store(0);
+}
+
+
+} // namespace anyseq
+
+
+
+//-------------------------------------------------------------------
+void anyseq_tile_pruning_record(std::int32_t blocks, std::int32_t skipped,
+                                std::int32_t reruns)
+{
+    auto& c = anyseq::counters();
+    c.alignments.fetch_add(1, std::memory_order_relaxed);
+    c.blocks.fetch_add(std::uint64_t(blocks), std::memory_order_relaxed);
+    c.skipped.fetch_add(std::uint64_t(skipped), std::memory_order_relaxed);
+    c.reruns.fetch_add(std::uint64_t(reruns), std::memory_order_relaxed);
+}
@@ -0,0 +1,45 @@
+#ifndef ANYSEQ_TILE_PRUNING_H_
+#define ANYSEQ_TILE_PRUNING_H_
+
+
+#include <cstdint>
+
+
+namespace anyseq {
+
+
+/*************************************************************************//**
+ *
+ * @brief blocks seen and skipped by pruned local scores
+ *        (see "scoring.impala": get_pruned_local_scoring_linmem)
+ *
+ *****************************************************************************/
+struct tile_pruning_statistics {
+    std::uint64_t alignments = 0;
+    std::uint64_t blocks = 0;
+    std::uint64_t skipped = 0;
+    std::uint64_t reruns = 0;   //alignments recomputed without pruning
+};
+
+
+/** @brief totals of all pruned local scores of this process */
+tile_pruning_statistics tile_pruning_totals();
+
+void reset_tile_pruning_totals();
+
+
+} // namespace anyseq
+
+
+
+extern "C" {
+
+// interface for "scoring.impala"
+
+void anyseq_tile_pruning_record(std::int32_t blocks, std::int32_t skipped,
+                                std::int32_t reruns);
+
+}
+
+
+#endif
@@ -0,0 +1,292 @@
+#include <iostream>
+#include <new>
+#include <stdexcept>
+
+#include <anydsl_runtime.h>
+
+#include "host_memory.h"
+#include "workspace.h"
+
+
+namespace anyseq {
+
+
+//-------------------------------------------------------------------
+// host buffers follow the allocation policy of "host_memory.h"
+static constexpr int host_device = 0;
+
+static void* allocate(int device, workspace::size_type size)
+{
+    if(device == host_device) return host_alloc(size);
+    return anydsl_alloc(device, size);
+}
+
+static void deallocate(int device, void* data, workspace::size_type size)
+{
+    if(device == host_device) host_release(data, size);
+    else anydsl_release(device, data);
+}
+
+
+
+//-------------------------------------------------------------------
+workspace::~workspace()
+{
+    clear();
+}
+
+
+
+//-------------------------------------------------------------------
+int workspace::size_class(size_type size)
+{
+    int c = min_class;
+    while(c < fine_class && (size_type(1) << c) < size) ++c;
+    if(c < fine_class) return c;
+
+    //4 classes from 2^k (inclusive) to 2^(k+1) (exclusive)
+    while(class_size(c) < size) ++c;
+    return c;
+}
+
+workspace::size_type workspace::class_size(int c)
+{
+    if(c <= fine_class) return size_type(1) << c;
+
+    const int k = fine_class + (c - fine_class) / 4;
+    const int q = (c - fine_class) % 4;
+    return (size_type(1) << k) + q * (size_type(1) << (k - 2));
+}
+
+
+
+//-------------------------------------------------------------------
+int workspace::device(kind k) const
+{
+    std::lock_guard<std::mutex> lock(mutables_);
+    return devices_[int(k)];
+}
+
+void workspace::device(kind k, int deviceId)
+{
+    std::lock_guard<std::mutex> lock(mutables_);
+    devices_[int(k)] = deviceId;
+}
+
+
+
+//-------------------------------------------------------------------
+void* workspace::acquire(kind k, size_type size)
+{
+    const int c = size_class(size);
+
+    std::lock_guard<std::mutex> lock(mutables_);
+
+    auto& lists = free_[int(k)];
+    if(int(lists.size()) > c && !lists[c].empty()) {
+        void* data = lists[c].back();
+        lists[c].pop_back();
+        cached_ -= class_size(c);
+        ++reuses_;
+        return data;
+    }
+
+    void* data = nullptr;
+    try {
+        data = allocate(devices_[int(k)], class_size(c));
+    }
+    catch(std::bad_alloc&) {
+        //buffers of other classes may take the memory
+        if(trim_locked(0) < 1) throw;
+        data = allocate(devices_[int(k)], class_size(c));
+    }
+    if(!data) throw std::bad_alloc{};
+
+    ++allocations_;
+    capacity_ += class_size(c);
+    return data;
+}
+
+
+
+//-------------------------------------------------------------------
+void workspace::release(kind k, void* data, size_type size)
+{
+    const int c = size_class(size);
+
+    std::lock_guard<std::mutex> lock(mutables_);
+
+    auto& lists = free_[int(k)];
+    if(int(lists.size()) <= c) lists.resize(c + 1);
+    lists[c].push_back(data);
+    cached_ += class_size(c);
+}
+
+
+
+//-------------------------------------------------------------------
+void workspace::reserve(kind k, size_type size, size_type count)
+{
+    const int c = size_class(size);
+
+    std::lock_guard<std::mutex> lock(mutables_);
+
+    const int device = devices_[int(k)];
+    if(device < 0) {
+        throw std::invalid_argument{"workspace: device of buffer kind not known"};
+    }
+
+    auto& lists = free_[int(k)];
+    if(int(lists.size()) <= c) lists.resize(c + 1);
+
+    while(size_type(lists[c].size()) < count) {
+        void* data = allocate(device, class_size(c));
+        if(!data) throw std::bad_alloc{};
+        lists[c].push_back(data);
+        ++allocations_;
+        capacity_ += class_size(c);
+        cached_ += class_size(c);
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+workspace::size_type workspace::trim(size_type keep)
+{
+    std::lock_guard<std::mutex> lock(mutables_);
+    return trim_locked(keep);
+}
+
+workspace::size_type workspace::trim_locked(size_type keep)
+{
+    size_type freed = 0;
+
+    while(cached_ > keep) {
+        //largest class with cached buffers of any kind
+        int c = -1;
+        for(int k = 0; k < num_kinds; ++k) {
+            for(int i = int(free_[k].size()) - 1; i > c; --i) {
+                if(!free_[k][i].empty()) { c = i; break; }
+            }
+        }
+        if(c < 0) break;
+
+        for(int k = 0; k < num_kinds && cached_ > keep; ++k) {
+            if(int(free_[k].size()) <= c) continue;
+            auto& list = free_[k][c];
+            while(!list.empty() && cached_ > keep) {
+                deallocate(devices_[k], list.back(), class_size(c));
+                list.pop_back();
+                cached_ -= class_size(c);
+                capacity_ -= class_size(c);
+                freed += class_size(c);
+            }
+        }
+    }
+    return freed;
+}
+
+
+
+//-------------------------------------------------------------------
+void workspace::clear()
+{
+    trim(0);
+}
+
+
+
+//-------------------------------------------------------------------
+workspace::size_type workspace::allocations() const
+{
+    std::lock_guard<std::mutex> lock(mutables_);
+    return allocations_;
+}
+
+workspace::size_type workspace::reuses() const
+{
+    std::lock_guard<std::mutex> lock(mutables_);
+    return reuses_;
+}
+
+workspace::size_type workspace::capacity() const
+{
+    std::lock_guard<std::mutex> lock(mutables_);
+    return capacity_;
+}
+
+workspace::size_type workspace::cached() const
+{
+    std::lock_guard<std::mutex> lock(mutables_);
+    return cached_;
+}
+
+
+} // namespace anyseq
+
+
+
+//-------------------------------------------------------------------
+// C interface
+//-------------------------------------------------------------------
+using anyseq::workspace;
+
+void* anyseq_workspace_create()
+{
+    return new workspace{};
+}
+
+void anyseq_workspace_destroy(void* ws)
+{
+    delete static_cast<workspace*>(ws);
+}
+
+std::int32_t anyseq_workspace_device(void* ws, std::int32_t kind)
+{
+    return static_cast<workspace*>(ws)->device(workspace::kind(kind));
+}
+
+void anyseq_workspace_register(void* ws, std::int32_t kind, std::int32_t device)
+{
+    static_cast<workspace*>(ws)->device(workspace::kind(kind), device);
+}
+
+//exceptions must not reach the Impala code
+void* anyseq_workspace_alloc(void* ws, std::int32_t kind, std::int64_t size)
+{
+    try {
+        return static_cast<workspace*>(ws)->acquire(workspace::kind(kind), size);
+    }
+    catch(std::exception& e) {
+        std::cerr << "workspace allocation of " << size << " bytes failed: "
+                  << e.what() << std::endl;
+        return nullptr;
+    }
+}
+
+void anyseq_workspace_release(void* ws, std::int32_t kind, void* data, std::int64_t size)
+{
+    static_cast<workspace*>(ws)->release(workspace::kind(kind), data, size);
+}
+
+bool anyseq_workspace_reserve(void* ws, std::int32_t kind, std::int64_t size, std::int64_t count)
+{
+    try {
+        static_cast<workspace*>(ws)->reserve(workspace::kind(kind), size, count);
+        return true;
+    }
+    catch(std::exception&) {
+        return false;
+    }
+}
+
+std::int64_t anyseq_workspace_trim(void* ws, std::int64_t keep)
+{
+    return static_cast<workspace*>(ws)->trim(keep);
+}
+
+std::int64_t anyseq_workspace_allocations(void* ws)
+{
+    return static_cast<workspace*>(ws)->allocations();
+}
@@ -0,0 +1,137 @@
+#ifndef ANYSEQ_WORKSPACE_H_
+#define ANYSEQ_WORKSPACE_H_
+
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+
+namespace anyseq {
+
+
+/*************************************************************************//**
+ *
+ * @brief buffer pool for the alignment functions
+ *
+ *        released buffers are kept in size classes and handed out again
+ *        for requests of the same class, so repeated alignments of similar
+ *        sizes do not allocate after the first one; classes are powers of
+ *        two up to 64 MiB and quarter steps between powers of two above,
+ *        so large buffers waste at most a quarter of their size;
+ *        buffers are separated by kind (device / host scratch memory)
+ *
+ *        safe to use from the worker threads of one alignment call,
+ *        but not meant to be shared by concurrent alignment calls
+ *
+ *****************************************************************************/
+class workspace
+{
+public:
+    using size_type = std::int64_t;
+
+    enum class kind : int { device = 0, host = 1 };
+
+    workspace() = default;
+
+    workspace(const workspace&) = delete;
+    workspace& operator = (const workspace&) = delete;
+
+    ~workspace();
+
+    /** @brief returns the runtime device id of a kind or -1 if unknown */
+    int device(kind) const;
+
+    /** @brief sets the runtime device id of a kind */
+    void device(kind, int deviceId);
+
+    /** @brief returns a cached buffer of size >= 'size'
+     *         or allocates a new one; if that fails, the cached buffers
+     *         are freed and the allocation is tried once more */
+    void* acquire(kind, size_type size);
+
+    /** @brief returns a buffer to the pool */
+    void release(kind, void* data, size_type size);
+
+    /** @brief allocates buffers up front so that at least 'count' buffers
+     *         for requests of 'size' bytes are cached, e.g. for the
+     *         largest input; throws std::invalid_argument if the device
+     *         of the kind is not known yet */
+    void reserve(kind, size_type size, size_type count = 1);
+
+    /** @brief frees cached buffers, largest first, until at most
+     *         'keep' bytes are cached; returns the number of bytes freed */
+    size_type trim(size_type keep = 0);
+
+    /** @brief frees all cached buffers */
+    void clear();
+
+    /** @brief number of buffers that had to be allocated */
+    size_type allocations() const;
+
+    /** @brief number of requests that were served from the pool */
+    size_type reuses() const;
+
+    /** @brief total size of all buffers owned by the pool */
+    size_type capacity() const;
+
+    /** @brief total size of the cached (not acquired) buffers */
+    size_type cached() const;
+
+    static int size_class(size_type);
+
+    /** @brief size of the buffers of a class */
+    static size_type class_size(int);
+
+private:
+    static constexpr int num_kinds = 2;
+    static constexpr int min_class = 6;  //64 bytes
+    static constexpr int fine_class = 26; //64 MiB; quarter steps above
+
+    size_type trim_locked(size_type keep);
+
+    using free_list = std::vector<void*>;
+
+    mutable std::mutex mutables_;
+    int devices_[num_kinds] = {-1, -1};
+    std::vector<free_list> free_[num_kinds];
+    size_type allocations_ = 0;
+    size_type reuses_ = 0;
+    size_type capacity_ = 0;
+    size_type cached_ = 0;
+};
+
+
+} // namespace anyseq
+
+
+
+extern "C" {
+
+// interface for "dynprog.impala" and for library users
+
+void* anyseq_workspace_create();
+
+void anyseq_workspace_destroy(void* workspace);
+
+std::int32_t anyseq_workspace_device(void* workspace, std::int32_t kind);
+
+void anyseq_workspace_register(void* workspace, std::int32_t kind, std::int32_t device);
+
+/// @brief returns null if the buffer can't be allocated
+void* anyseq_workspace_alloc(void* workspace, std::int32_t kind, std::int64_t size);
+
+void anyseq_workspace_release(void* workspace, std::int32_t kind, void* data, std::int64_t size);
+
+/// @brief returns false if the buffers can't be allocated
+bool anyseq_workspace_reserve(void* workspace, std::int32_t kind, std::int64_t size, std::int64_t count);
+
+/// @brief returns the number of bytes freed
+std::int64_t anyseq_workspace_trim(void* workspace, std::int64_t keep);
+
+std::int64_t anyseq_workspace_allocations(void* workspace);
+
+}
+
+
+#endif